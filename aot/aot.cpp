@@ -0,0 +1,44 @@
+/* Compiles a ROM ahead of time. Every block that can be found statically is
+ * compiled by the same backend as the JIT into an object file, which is
+ * linked into a module for Gameboy::loadPrecompiled. See mjkgb_precompile in
+ * cmake/MjkgbAot.cmake for building one.
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+
+#include "gameboy_impl.hpp"
+
+using namespace std;
+using namespace mjkgb;
+
+int
+main(int argc, char **argv)
+{
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s ROM OBJECT\n", argv[0]);
+        return 2;
+    }
+
+    ifstream rom{argv[1], ios::binary};
+    if (!rom) {
+        fprintf(stderr, "could not open %s\n", argv[1]);
+        return 2;
+    }
+
+    GameboyImpl gb;
+    gb.mmu_.load(rom);
+
+    Compiler::block_list blocks;
+    for (auto address : Jit::discover(gb.mmu_))
+        blocks.emplace_back(address, Jit::decode(gb.mmu_, address));
+
+    if (!Compiler::emit(argv[2], CodeCache::hash(gb.mmu_), blocks)) {
+        fprintf(stderr, "could not compile %s\n", argv[1]);
+        return 1;
+    }
+
+    printf("%zu blocks\n", blocks.size());
+    return 0;
+}
@@ -0,0 +1,175 @@
+/* Micro-benchmarks for the interpreter, operand accessors and the JIT. Run
+ * with --benchmark_out=FILE --benchmark_out_format=json, or build the
+ * bench_json target, to get results which can be compared across commits.
+ */
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "compiler.hpp"
+#include "gameboy_impl.hpp"
+
+using namespace std;
+using namespace mjkgb;
+
+namespace {
+
+constexpr int repeats = 1000;
+
+/* LD SP, 0xdffe; LD HL, 0xc000, so the repeated instruction can use both */
+const string prologue{"\x31\xfe\xdf\x21\x00\xc0", 6};
+const string stop{"\x10\x00", 2};
+
+void load(GameboyImpl &gb, const string &code)
+{
+    stringstream stream{code};
+    gb.load(stream);
+}
+
+/* Runs repeats copies of an instruction followed by STOP, from power on */
+void opcode(benchmark::State &state, const string &instruction)
+{
+    string code{prologue};
+    for (auto i = 0; i < repeats; ++i)
+        code += instruction;
+    code += stop;
+
+    GameboyImpl gb;
+    load(gb, code);
+    for (auto _ : state) {
+        gb.set(WordRegister::PC, 0);
+        gb.run();
+    }
+
+    state.SetItemsProcessed(state.iterations() * repeats);
+}
+
+template<typename T>
+void get(benchmark::State &state, T operand)
+{
+    GameboyImpl gb;
+    gb.set(WordRegister::HL, 0xc000);
+    for (auto _ : state) {
+        gb.set(WordRegister::PC, 0xc000);
+        benchmark::DoNotOptimize(gb.get(operand));
+    }
+}
+
+/* HL is reset every iteration, so that operands which step it keep writing
+ * to WRAM rather than sweeping the whole address space
+ */
+template<typename T>
+void set(benchmark::State &state, T operand)
+{
+    GameboyImpl gb;
+    for (auto _ : state) {
+        gb.set(WordRegister::HL, 0xc000);
+        gb.set(operand, 0x42);
+        benchmark::ClobberMemory();
+    }
+}
+
+/* A block of LD A, B; INC A; XOR B; ... cycling through a few cheap opcodes
+ * of the given length, compiled at the given tier. Every compile adds to the
+ * same module, as it would over a long run.
+ */
+void compile(benchmark::State &state, Compiler::Tier tier)
+{
+    static const uint8_t ops[] = { 0x78, 0x3c, 0xa8, 0x47, 0x05 };
+
+    vector<uint8_t> block;
+    for (auto i = 0; i < state.range(0); ++i)
+        block.push_back(ops[i % sizeof(ops)]);
+
+    Compiler compiler;
+    uint16_t address = 0;
+    for (auto _ : state)
+        benchmark::DoNotOptimize(compiler.compile(address++, block, tier));
+
+    state.SetComplexityN(state.range(0));
+}
+
+/* LD C, 0x40; LD HL, 0xc000; outer: LD B, 0x40;
+ * inner: INC (HL); SWAP (HL); ADD A, (HL); DEC B; JR NZ, inner;
+ * LD (HL+), A; DEC C; JR NZ, outer; STOP
+ */
+const string loop{"\x0e\x40\x21\x00\xc0\x06\x40\x34\xcb\x36\x86\x05\x20\xf9"
+    "\x22\x0d\x20\xf3\x10\x00", 20};
+
+void loop_throughput(benchmark::State &state)
+{
+    GameboyImpl gb;
+    load(gb, loop);
+    gb.jit_.set_threshold(static_cast<unsigned>(state.range(0)));
+
+    /* Leave compiling out of the measurement */
+    gb.run();
+
+    unsigned long cycles = 0;
+    for (auto _ : state) {
+        gb.set(WordRegister::PC, 0);
+        gb.run();
+        cycles += gb.cpu_.get_clock();
+    }
+
+    state.counters["cycles/s"] = benchmark::Counter(static_cast<double>(cycles),
+            benchmark::Counter::kIsRate);
+    state.counters["blocks"] = static_cast<double>(gb.jit_.compiled());
+}
+
+void register_all()
+{
+    const pair<const char *, string> opcodes[] = {
+        { "nop", string{"\x00", 1} },
+        { "ld_A_B", "\x78" },
+        { "inc_A", "\x3c" },
+        { "add_A_n", "\xc6\x01" },
+        { "ld_A_pHL", "\x7e" },
+        { "ld_pHL_A", "\x77" },
+        { "inc_pHL", "\x34" },
+        { "ld_A_pnn", string{"\xfa\x00\xc0", 3} },
+        { "ld_BC_nn", "\x01\x34\x12" },
+        { "push_pop_BC", "\xc5\xc1" },
+        { "swap_A", "\xcb\x37" },
+        { "jr_0", string{"\x18\x00", 2} },
+    };
+    for (const auto &op : opcodes)
+        benchmark::RegisterBenchmark((string{"Opcode/"} + op.first).c_str(), opcode, op.second);
+
+    benchmark::RegisterBenchmark("Get/Register", get<ByteRegister>, ByteRegister::A);
+    benchmark::RegisterBenchmark("Get/ByteImmediate", get<ByteImmediate>, ByteImmediate{});
+    benchmark::RegisterBenchmark("Get/WordImmediate", get<WordImmediate>, WordImmediate{});
+    benchmark::RegisterBenchmark("Get/BytePointer", get<decltype(byte_ptr(WordRegister::HL))>,
+            byte_ptr(WordRegister::HL));
+    benchmark::RegisterBenchmark("Get/BytePointerHigh", get<decltype(byte_ptr(ByteRegister::C))>,
+            byte_ptr(ByteRegister::C));
+    benchmark::RegisterBenchmark("Get/WordPointer", get<decltype(word_ptr(WordRegister::HL))>,
+            word_ptr(WordRegister::HL));
+    benchmark::RegisterBenchmark("Set/BytePointer", set<decltype(byte_ptr(WordRegister::HL))>,
+            byte_ptr(WordRegister::HL));
+    benchmark::RegisterBenchmark("Set/BytePointerIncrement", set<decltype(byte_ptr<1>(WordRegister::HL))>,
+            byte_ptr<1>(WordRegister::HL));
+    benchmark::RegisterBenchmark("Set/WordPointer", set<decltype(word_ptr(WordRegister::HL))>,
+            word_ptr(WordRegister::HL));
+
+    benchmark::RegisterBenchmark("Compile/Baseline", compile, Compiler::Tier::BASELINE)
+        ->RangeMultiplier(2)->Range(1, 64)->Complexity();
+    benchmark::RegisterBenchmark("Compile/Optimized", compile, Compiler::Tier::OPTIMIZED)
+        ->RangeMultiplier(2)->Range(1, 64)->Complexity();
+
+    benchmark::RegisterBenchmark("Loop/Interpreter", loop_throughput)->Arg(0);
+    benchmark::RegisterBenchmark("Loop/JIT", loop_throughput)->Arg(1);
+}
+
+}
+
+int
+main(int argc, char **argv)
+{
+    register_all();
+    benchmark::Initialize(&argc, argv);
+    benchmark::RunSpecifiedBenchmarks();
+    return 0;
+}
@@ -0,0 +1,175 @@
+/* Replays a recorded movie against a ROM headless and as fast as possible,
+ * once per execution mode, and reports how fast each ran along with a hash of
+ * the final machine state. The hashes of every mode must match each other,
+ * and the expected hash if one is given.
+ *
+ * A movie is a file of one byte per frame, holding the buttons held during
+ * that frame as a mask of Gameboy::Button values.
+ */
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "mjkgb.hpp"
+
+using namespace std;
+using namespace mjkgb;
+
+namespace {
+
+struct Mode {
+    const char *name;
+    unsigned threshold;
+};
+
+struct Result {
+    double seconds;
+    unsigned long cycles;
+    size_t blocks;
+    uint64_t hash;
+};
+
+Result replay(const string &rom, const vector<uint8_t> &movie, size_t frames,
+        unsigned threshold)
+{
+    Gameboy gb{rom};
+    gb.setAudioEnabled(false);
+    gb.setJitThreshold(threshold);
+
+    /* The whole movie is queued up front, so running it never has to come
+     * back to the host for input
+     */
+    for (size_t frame = 0; frame < movie.size(); ++frame)
+        gb.queueButtonsAtFrame(frame, movie[frame]);
+
+    auto start = chrono::steady_clock::now();
+    for (size_t frame = 0; frame < frames; ++frame)
+        gb.runFrame();
+    auto end = chrono::steady_clock::now();
+
+    return {
+        chrono::duration<double>(end - start).count(),
+        gb.cycles(),
+        gb.compiledBlocks(),
+        gb.stateHash()
+    };
+}
+
+void usage(const char *name)
+{
+    fprintf(stderr,
+            "usage: %s ROM [MOVIE] [--frames N] [--mode interpreter|jit|mixed|all]\n"
+            "       [--threshold N] [--expect HASH] [--precompiled MODULE]\n"
+            "       [--perf-map] [--jitdump DIRECTORY]\n", name);
+    exit(2);
+}
+
+}
+
+int
+main(int argc, char **argv)
+{
+    string rom, movie_file;
+    size_t frames = 0;
+    string mode = "all";
+    unsigned threshold = 16;
+    string expect;
+    string precompiled;
+    auto perf_map = false;
+    string jitdump;
+
+    for (int i = 1; i < argc; ++i) {
+        auto arg = string{argv[i]};
+        auto value = [&] {
+            if (++i == argc)
+                usage(argv[0]);
+            return string{argv[i]};
+        };
+
+        if (arg == "--frames")
+            frames = stoul(value());
+        else if (arg == "--mode")
+            mode = value();
+        else if (arg == "--threshold")
+            threshold = static_cast<unsigned>(stoul(value()));
+        else if (arg == "--expect")
+            expect = value();
+        else if (arg == "--precompiled")
+            precompiled = value();
+        else if (arg == "--perf-map")
+            perf_map = true;
+        else if (arg == "--jitdump")
+            jitdump = value();
+        else if (arg[0] == '-' || !movie_file.empty())
+            usage(argv[0]);
+        else if (rom.empty())
+            rom = arg;
+        else
+            movie_file = arg;
+    }
+    if (rom.empty())
+        usage(argv[0]);
+
+    if (perf_map || !jitdump.empty())
+        Gameboy::enableJitPerfMap(jitdump);
+
+    /* Precompiled blocks run in every mode, including the interpreter */
+    if (!precompiled.empty() && !Gameboy::loadPrecompiled(precompiled)) {
+        fprintf(stderr, "could not load %s\n", precompiled.c_str());
+        return 2;
+    }
+
+    vector<uint8_t> movie;
+    if (!movie_file.empty()) {
+        ifstream is{movie_file, ios::binary};
+        if (!is) {
+            fprintf(stderr, "could not open %s\n", movie_file.c_str());
+            return 2;
+        }
+        movie.assign(istreambuf_iterator<char>{is}, istreambuf_iterator<char>{});
+    }
+    if (!frames)
+        frames = movie.empty() ? 3600 : movie.size();
+
+    const Mode modes[] = {
+        { "interpreter", 0 },
+        { "jit", 1 },
+        { "mixed", threshold },
+    };
+
+    printf("%-12s %10s %12s %12s %8s  %s\n",
+            "mode", "seconds", "frames/s", "Mcycles/s", "blocks", "state hash");
+
+    auto failed = false;
+    uint64_t first = 0;
+    auto ran = 0;
+    for (const auto &m : modes) {
+        if (mode != "all" && mode != m.name)
+            continue;
+
+        auto result = replay(rom, movie, frames, m.threshold);
+        printf("%-12s %10.3f %12.1f %12.2f %8zu  %016llx\n",
+                m.name, result.seconds, frames / result.seconds,
+                result.cycles / result.seconds / 1e6, result.blocks,
+                static_cast<unsigned long long>(result.hash));
+
+        if (!ran++)
+            first = result.hash;
+        else if (result.hash != first)
+            failed = true;
+        if (!expect.empty() && result.hash != stoull(expect, nullptr, 16))
+            failed = true;
+    }
+
+    if (!ran)
+        usage(argv[0]);
+    if (failed)
+        fprintf(stderr, "state hash mismatch\n");
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,30 @@
+# - Build a module of a ROM compiled ahead of time
+#
+#   mjkgb_precompile(<target> <rom>)
+#
+# Runs mjkgb_aot over the ROM and links the object it writes into a shared
+# module <target>.so, for Gameboy::loadPrecompiled. The module must be rebuilt
+# whenever the ROM or libmjkgb's opcodes change, and is rejected at load time
+# otherwise.
+
+function(mjkgb_precompile target rom)
+    get_filename_component(rom_path ${rom} ABSOLUTE)
+    set(object ${CMAKE_CURRENT_BINARY_DIR}/${target}.o)
+
+    add_custom_command(OUTPUT ${object}
+        COMMAND mjkgb_aot ${rom_path} ${object}
+        DEPENDS mjkgb_aot ${rom_path}
+        COMMENT "Precompiling ${rom}"
+    )
+    set_source_files_properties(${object}
+        PROPERTIES
+        EXTERNAL_OBJECT true
+        GENERATED true
+    )
+    add_library(${target} MODULE ${object})
+    set_target_properties(${target}
+        PROPERTIES
+        LINKER_LANGUAGE C
+        PREFIX ""
+    )
+endfunction()
@@ -1,10 +1,14 @@
 #ifndef MJKGB_HPP_
 #define MJKGB_HPP_
 
+#include <array>
+#include <cstddef>
 #include <cstdint>
+#include <functional>
 #include <iosfwd>
 #include <memory>
 #include <string>
+#include <vector>
 
 namespace mjkgb {
 
@@ -12,19 +16,242 @@ class Gameboy {
 public:
     static constexpr int xres = 160;
     static constexpr int yres = 144;
+    static constexpr int default_audio_rate = 48000;
 
     Gameboy();
     explicit Gameboy(const std::string &filename);
     ~Gameboy();
 
-    using vsync_cb = std::function<void(const std::array<uint8_t, 3 * xres * yres> &)>;
+    /* Independent copy of this machine, for branching searches. Compiled code
+     * is shared between the two rather than copied. Callbacks and rewind
+     * history aren't copied.
+     */
+    std::unique_ptr<Gameboy> clone() const;
+
+    /* Called at the start of every VBlank with the finished frame. There is
+     * no renderer yet, so the frame is blank.
+     */
+    using frame = std::array<uint8_t, 3 * xres * yres>;
+    using vsync_cb = std::function<void(const frame &)>;
     void setVsyncCallback(vsync_cb callback);
 
+    /* Buttons are a mask of these values */
+    enum Button : uint8_t {
+        RIGHT = 0x01, LEFT = 0x02, UP = 0x04, DOWN = 0x08,
+        A = 0x10, B = 0x20, SELECT = 0x40, START = 0x80
+    };
+
+    /* Hold exactly the given buttons from now on */
+    void setButtons(uint8_t buttons);
+
+    /* Queue a change of the held buttons, either the given number of cycles
+     * from now or at the start of the given VBlank from now, so that it is
+     * applied as that many calls to runFrame() return. Queued changes are
+     * discarded by run(), loading a state and clearQueuedButtons().
+     */
+    void queueButtons(unsigned long cycles, uint8_t buttons);
+    void queueButtonsAtFrame(unsigned long frames, uint8_t buttons);
+    void clearQueuedButtons();
+
+    /* Copy up to frames stereo frames of interleaved signed 16-bit samples at
+     * the audio rate into buffer, returning the number copied. May be called
+     * from a different thread to the one running the emulator.
+     */
+    size_t readAudio(int16_t *buffer, size_t frames);
+
+    /* Audio settings, only to be changed while the emulator isn't running.
+     * Rates are clamped to 8 kHz to 192 kHz. Disabling audio skips sample
+     * synthesis entirely, while keeping the sound registers behaving correctly
+     * for the game.
+     */
+    void setAudioRate(int rate);
+    void setAudioEnabled(bool enabled);
+
     void load(const std::string &filename);
     void load(std::istream &is);
 
+    /* Run from power on until STOP */
     void run();
 
+    /* Run from wherever the last run stopped, without resetting, until the
+     * first instruction boundary at least cycles later or the start of the
+     * next VBlank respectively. Either returns early on STOP.
+     */
+    void runCycles(unsigned long cycles);
+    void runFrame();
+
+    /* Save states capture the whole machine in a versioned binary format.
+     * Saving into a buffer returns the number of bytes written, or 0 if it is
+     * too small. Loading returns false and leaves the machine untouched if the
+     * data isn't a state this version can restore.
+     *
+     * Full states are always stateSize() bytes. Deltas only hold the memory
+     * pages written since the last state was saved or loaded, and are never
+     * larger than a full state. A delta only loads into a machine whose last
+     * state saved or loaded was that parent, and which hasn't written to
+     * memory since; otherwise loading it returns false.
+     *
+     * stateHash() is equal for machines in the same state, for checking runs
+     * against each other, where saved states differ in their generation.
+     */
+    size_t stateSize() const;
+    size_t saveState(uint8_t *buffer, size_t size);
+    std::vector<uint8_t> saveState();
+    size_t saveDelta(uint8_t *buffer, size_t size);
+    std::vector<uint8_t> saveDelta();
+    bool loadState(const uint8_t *data, size_t size);
+    bool loadState(const std::vector<uint8_t> &state);
+    uint64_t stateHash() const;
+
+    /* Rewind history. With a non-zero memory budget in bytes, the state at
+     * the start of every VBlank is kept for as many frames as fit, compressed
+     * on a helper thread. rewind() restores the state from the given number
+     * of frames ago, discarding later history, and returns false if there
+     * isn't that much history. After rewinding, the next delta saved holds
+     * every page.
+     */
+    void setRewindBudget(size_t bytes);
+    size_t rewindFrames() const;
+    bool rewind(size_t frames);
+
+    /* Number of cycles skipped by fast forwarding through busy-wait loops */
+    unsigned long idleCyclesSkipped() const;
+
+    /* Machine cycles run since power on */
+    unsigned long cycles() const;
+
+    /* Sample the guest's PC and call stack every period cycles, discarding
+     * any earlier samples. Only available when built with MJKGB_PROFILER,
+     * returning false otherwise.
+     */
+    bool startProfiling(unsigned long period);
+    void stopProfiling();
+
+    /* Samples so far in collapsed stack format for flame graphs, a line for
+     * each distinct stack of bank:address frames and its number of samples
+     */
+    std::string profile() const;
+
+    /* Blocks of ROM are compiled to native code once they have been jumped to
+     * this many times, up to 255. 1 compiles everything reached by a jump
+     * and 0, the default, interprets everything.
+     */
+    void setJitThreshold(unsigned jumps);
+    size_t compiledBlocks() const;
+
+    /* Compiled blocks start out quickly generated, and are recompiled with
+     * full optimization once entered this many times, up to 65534. 0 never
+     * recompiles. Defaults to 1000.
+     */
+    void setJitOptimizeThreshold(unsigned entries);
+    size_t optimizedBlocks() const;
+
+    /* Directory in which to remember which blocks each ROM compiled, so that
+     * the next process to load it compiles them up front on a helper thread,
+     * into a module kept there for the processes after it to load directly.
+     * Linking the module needs the C compiler libmjkgb was built with. Applies
+     * to ROMs not already loaded by another machine.
+     */
+    static void setJitCacheDirectory(const std::string &directory);
+
+    /* Load a module built by mjkgb_precompile. Its blocks are installed into
+     * every machine which then loads its ROM, with the interpreter and JIT
+     * covering whatever it missed. Returns false if the module can't be
+     * loaded or was built against a different version of the library.
+     */
+    static bool loadPrecompiled(const std::string &path);
+
+    /* Name compiled code for host profilers in /tmp/perf-<pid>.map, by the
+     * bank, address and opcodes of each block. With a directory, a
+     * jit-<pid>.dump for perf inject --jit is also written there. Covers code
+     * compiled and precompiled modules loaded from then on, and stays on for
+     * the rest of the process. GDB is always told about compiled code, through
+     * its JIT interface.
+     */
+    static void enableJitPerfMap(const std::string &dump_directory = "");
+
+private:
+    class impl;
+    explicit Gameboy(std::unique_ptr<impl> pimpl);
+
+    std::unique_ptr<impl> pimpl_;
+
+    friend class Batch;
+    friend class VectorEnv;
+};
+
+/* A set of independent machines stepped together in rounds on a work
+ * stealing thread pool. Every round runs each machine by the same amount and
+ * returns once all of them have finished.
+ */
+class Batch {
+public:
+    /* count clones of prototype, run on the given number of threads or one
+     * per core if 0
+     */
+    Batch(const Gameboy &prototype, size_t count, unsigned threads = 0);
+    ~Batch();
+
+    size_t size() const;
+    Gameboy &operator[](size_t index);
+
+    /* Called from a worker thread just before each machine is stepped */
+    using input_cb = std::function<void(size_t index, Gameboy &gb)>;
+    void setInputCallback(input_cb callback);
+
+    /* After each round, copy size bytes of memory from address out of every
+     * machine into one buffer, size bytes apart
+     */
+    void setRamOutput(uint16_t address, size_t size);
+    const uint8_t *ram(size_t index) const;
+
+    void runCycles(unsigned long cycles);
+    void runFrame();
+
+private:
+    class impl;
+    std::unique_ptr<impl> pimpl_;
+
+    friend class VectorEnv;
+};
+
+/* Batched environment for training. Each step applies one action to every
+ * machine, runs them all for a number of frames in parallel, and writes each
+ * machine's observation straight into a caller owned buffer at a fixed
+ * stride.
+ *
+ * An observation is the configured memory ranges concatenated. With frame
+ * stacking each slot holds the last few observations, oldest first, shifted
+ * along in place every step. With max pooling the newest observation is the
+ * bytewise maximum of the last two frames run.
+ */
+class VectorEnv {
+public:
+    VectorEnv(const Gameboy &prototype, size_t count, unsigned threads = 0);
+    ~VectorEnv();
+
+    size_t size() const;
+    Gameboy &operator[](size_t index);
+
+    void addRamObservation(uint16_t address, size_t size);
+    void setFrameStack(size_t frames);
+    void setFrameSkip(size_t frames);
+    void setMaxPool(bool enabled);
+
+    /* Bytes of each machine's slot used, the stride must be at least this */
+    size_t observationSize() const;
+
+    /* Applies actions[index] to each machine, called from a worker thread.
+     * Without a callback each action is the buttons held for the step.
+     */
+    using action_cb = std::function<void(size_t index, uint8_t action, Gameboy &gb)>;
+    void setActionCallback(action_cb callback);
+
+    /* Fill every stacked frame of every slot with the current observation */
+    void observe(uint8_t *observations, size_t stride);
+
+    void step(const uint8_t *actions, uint8_t *observations, size_t stride);
+
 private:
     class impl;
     std::unique_ptr<impl> pimpl_;
@@ -0,0 +1,552 @@
+#include <algorithm>
+
+#include "apu.hpp"
+#include "gameboy_impl.hpp"
+#include "mmu.hpp"
+#include "scheduler.hpp"
+#include "state.hpp"
+
+namespace mjkgb {
+
+using namespace std;
+
+constexpr uint16_t Apu::first_address;
+constexpr uint16_t Apu::last_address;
+constexpr uint16_t Apu::nr52_address;
+constexpr uint16_t Apu::wave_address;
+constexpr unsigned long Apu::apu_rate;
+constexpr unsigned Apu::default_sample_rate;
+constexpr unsigned Apu::min_sample_rate;
+constexpr unsigned Apu::max_sample_rate;
+constexpr unsigned long Apu::update_cycles;
+constexpr unsigned long Apu::never;
+constexpr unsigned long Apu::sequencer_period;
+constexpr size_t Apu::synth_capacity;
+
+namespace {
+
+constexpr uint16_t nr10_address = 0xff10;
+constexpr uint16_t nr30_address = 0xff1a;
+constexpr uint16_t nr32_address = 0xff1c;
+constexpr uint16_t nr43_address = 0xff22;
+constexpr uint16_t nr50_address = 0xff24;
+constexpr uint16_t nr51_address = 0xff25;
+
+/* Each channel has five registers starting at these offsets */
+constexpr int registers_per_channel = 5;
+
+/* Unused and write only bits read back as 1 */
+const uint8_t read_masks[] = {
+    0x80, 0x3f, 0x00, 0xff, 0xbf,
+    0xff, 0x3f, 0x00, 0xff, 0xbf,
+    0x7f, 0xff, 0x9f, 0xff, 0xbf,
+    0xff, 0xff, 0x00, 0x00, 0xbf,
+    0x00, 0x00, 0x70, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff
+};
+
+const uint8_t duty_table[] = {
+    0x01, 0x81, 0x87, 0x7e
+};
+
+const unsigned long noise_divisors[] = {
+    4, 8, 16, 24, 32, 40, 48, 56
+};
+
+/* Amplitude of one step of a channel at full master volume */
+constexpr int amplitude = 64;
+
+inline uint16_t channel_register(int ch, int index)
+{
+    return static_cast<uint16_t>(Apu::first_address + registers_per_channel * ch + index);
+}
+
+uint8_t read_apu(GameboyImpl &gb, uint16_t address)
+{
+    return gb.apu_.read(gb, address);
+}
+
+void write_apu(GameboyImpl &gb, uint16_t address, uint8_t value)
+{
+    gb.apu_.write(gb, address, value);
+}
+
+unsigned long apu_stable_until(GameboyImpl &gb, uint16_t, unsigned long clock)
+{
+    return gb.apu_.next_sequencer_clock(clock);
+}
+
+void apu_update(GameboyImpl &gb)
+{
+    auto clock = gb.cpu_.get_clock();
+    gb.apu_.update(gb, clock);
+    gb.scheduler_.schedule(Event::APU_UPDATE, clock + Apu::update_cycles);
+}
+
+}
+
+Apu::Apu()
+  : registers_(),
+    channels_(),
+    power_(true),
+    synthesis_(true),
+    time_(0),
+    next_sequencer_(sequencer_period),
+    sequencer_step_(0),
+    sweep_enabled_(false),
+    sweep_timer_(0),
+    sweep_shadow_(0),
+    synth_(apu_rate, default_sample_rate, synth_capacity),
+    output_(1 << 15)
+{
+    for (auto &c : channels_)
+        c.next = never;
+}
+
+unsigned long Apu::next_sequencer_clock(unsigned long clock) const
+{
+    return (2 * clock / sequencer_period + 1) * sequencer_period / 2;
+}
+
+void Apu::update(GameboyImpl &gb, unsigned long clock)
+{
+    auto to = 2 * clock;
+
+    while (time_ < to) {
+        auto until = min(to, next_sequencer_);
+        if (synthesis_)
+            run_channels(until);
+        time_ = until;
+
+        if (time_ == next_sequencer_) {
+            step_sequencer();
+            next_sequencer_ += sequencer_period;
+            if (synthesis_)
+                synth_.end_frame(time_, output_);
+        }
+    }
+}
+
+uint8_t Apu::read(GameboyImpl &gb, uint16_t address)
+{
+    update(gb, gb.cpu_.get_clock());
+
+    if (address == nr52_address) {
+        uint8_t status = power_ ? 0xf0 : 0x70;
+        for (int ch = 0; ch < num_channels; ++ch)
+            if (channels_[ch].enabled)
+                status |= 1 << ch;
+        return status;
+    }
+
+    if (address >= wave_address)
+        return reg(address);
+    return reg(address) | read_masks[address - first_address];
+}
+
+void Apu::write(GameboyImpl &gb, uint16_t address, uint8_t value)
+{
+    update(gb, gb.cpu_.get_clock());
+
+    if (address == nr52_address) {
+        if (power_ && !(value & 0x80))
+            power_off();
+        power_ = value & 0x80;
+        return;
+    }
+
+    if (!power_ && address < wave_address)
+        return;
+
+    registers_[address - first_address] = value;
+
+    auto offset = address - first_address;
+    if (offset < num_channels * registers_per_channel) {
+        auto ch = offset / registers_per_channel;
+        auto &c = channels_[ch];
+
+        switch (offset % registers_per_channel) {
+        case 0:
+            if (address == nr30_address) {
+                c.dac = value & 0x80;
+                c.enabled = c.enabled && c.dac;
+            }
+            break;
+        case 1:
+            c.length = ch == WAVE ? 0x100 - value : 0x40 - (value & 0x3f);
+            break;
+        case 2:
+            if (ch != WAVE) {
+                c.dac = value & 0xf8;
+                c.enabled = c.enabled && c.dac;
+            }
+            break;
+        case 3:
+            if (ch != NOISE)
+                c.frequency = (c.frequency & 0x700) | value;
+            break;
+        case 4:
+            if (ch != NOISE)
+                c.frequency = static_cast<uint16_t>((c.frequency & 0xff) | (value & 0x07) << 8);
+            c.length_enabled = value & 0x40;
+            if (value & 0x80)
+                trigger(ch);
+            break;
+        }
+    }
+
+    output_all();
+}
+
+void Apu::set_sample_rate(unsigned rate)
+{
+    synth_.set_rate(min(max(rate, min_sample_rate), max_sample_rate));
+    synth_.reset(time_);
+    for (auto &c : channels_)
+        c.left = c.right = 0;
+    output_all();
+}
+
+void Apu::set_synthesis(bool enabled)
+{
+    if (enabled == synthesis_)
+        return;
+
+    synthesis_ = enabled;
+    if (!enabled)
+        return;
+
+    /* Waveform timers weren't run while disabled, restart them from now */
+    for (int ch = 0; ch < num_channels; ++ch) {
+        auto &c = channels_[ch];
+        auto p = period(ch);
+        c.next = c.next == never || p == never ? never : time_ + p;
+        c.left = c.right = 0;
+    }
+
+    synth_.reset(time_);
+    output_all();
+}
+
+void Apu::reset(GameboyImpl &gb)
+{
+    registers_.fill(0);
+    for (auto &c : channels_) {
+        c = Channel{};
+        c.next = never;
+    }
+
+    power_ = true;
+    time_ = 2 * gb.cpu_.get_clock();
+    next_sequencer_ = (time_ / sequencer_period + 1) * sequencer_period;
+    sequencer_step_ = 0;
+    sweep_enabled_ = false;
+    sweep_timer_ = 0;
+    sweep_shadow_ = 0;
+    synth_.reset(time_);
+
+    gb.scheduler_.schedule(Event::APU_UPDATE, gb.cpu_.get_clock() + update_cycles);
+}
+
+void Apu::save_state(StateWriter &state) const
+{
+    state.put(registers_.data(), registers_.size());
+
+    for (const auto &c : channels_) {
+        state.put(c.enabled);
+        state.put(c.dac);
+        state.put(c.length_enabled);
+        state.put(c.length);
+        state.put(c.volume);
+        state.put(c.envelope_period);
+        state.put(c.envelope_timer);
+        state.put(c.envelope_up);
+        state.put(c.frequency);
+        state.put(c.position);
+        state.put(c.lfsr);
+        state.put<uint64_t>(c.next);
+    }
+
+    state.put(power_);
+    state.put<uint64_t>(time_);
+    state.put<uint64_t>(next_sequencer_);
+    state.put(sequencer_step_);
+    state.put(sweep_enabled_);
+    state.put(sweep_timer_);
+    state.put(sweep_shadow_);
+}
+
+void Apu::load_state(StateReader &state)
+{
+    copy_n(state.bytes(registers_.size()), registers_.size(), registers_.begin());
+
+    for (auto &c : channels_) {
+        state.get(c.enabled);
+        state.get(c.dac);
+        state.get(c.length_enabled);
+        state.get(c.length);
+        state.get(c.volume);
+        state.get(c.envelope_period);
+        state.get(c.envelope_timer);
+        state.get(c.envelope_up);
+        state.get(c.frequency);
+        state.get(c.position);
+        state.get(c.lfsr);
+        c.next = static_cast<unsigned long>(state.get<uint64_t>());
+    }
+
+    state.get(power_);
+    time_ = static_cast<unsigned long>(state.get<uint64_t>());
+    next_sequencer_ = static_cast<unsigned long>(state.get<uint64_t>());
+    state.get(sequencer_step_);
+    state.get(sweep_enabled_);
+    state.get(sweep_timer_);
+    state.get(sweep_shadow_);
+
+    /* Timers are stale if the state was saved with synthesis disabled */
+    for (int ch = 0; ch < num_channels; ++ch) {
+        auto &c = channels_[ch];
+        auto p = period(ch);
+        if (c.next != never && c.next < time_)
+            c.next = p == never ? never : time_ + p;
+        c.left = c.right = 0;
+    }
+
+    synth_.reset(time_);
+    output_all();
+}
+
+void Apu::attach(Mmu &mmu, Scheduler &scheduler)
+{
+    for (auto address = first_address; address <= last_address; ++address)
+        mmu.set_io_handler(address, { read_apu, write_apu, apu_stable_until });
+    scheduler.set_handler(Event::APU_UPDATE, apu_update);
+}
+
+unsigned long Apu::period(int ch) const
+{
+    const auto &c = channels_[ch];
+
+    switch (ch) {
+    case SQUARE1:
+    case SQUARE2:
+        return 2 * (0x800 - c.frequency);
+    case WAVE:
+        return 0x800 - c.frequency;
+    default: {
+        auto nr43 = reg(nr43_address);
+        auto shift = nr43 >> 4;
+        if (shift >= 14)
+            return never;
+        return noise_divisors[nr43 & 0x07] << shift;
+    }
+    }
+}
+
+int Apu::level(int ch) const
+{
+    const auto &c = channels_[ch];
+    if (!c.enabled || !c.dac)
+        return 0;
+
+    switch (ch) {
+    case SQUARE1:
+    case SQUARE2: {
+        auto duty = reg(channel_register(ch, 1)) >> 6;
+        return (duty_table[duty] >> c.position & 1) ? c.volume : 0;
+    }
+    case WAVE: {
+        auto code = reg(nr32_address) >> 5 & 0x03;
+        auto byte = reg(static_cast<uint16_t>(wave_address + c.position / 2));
+        auto sample = (c.position & 1) ? byte & 0x0f : byte >> 4;
+        return code ? sample >> (code - 1) : 0;
+    }
+    default:
+        return (c.lfsr & 1) ? 0 : c.volume;
+    }
+}
+
+void Apu::run_channels(unsigned long until)
+{
+    for (int ch = 0; ch < num_channels; ++ch) {
+        auto &c = channels_[ch];
+        while (c.next < until) {
+            step_channel(ch);
+            output(ch, c.next);
+
+            auto p = period(ch);
+            c.next = p == never ? never : c.next + p;
+        }
+    }
+}
+
+void Apu::step_channel(int ch)
+{
+    auto &c = channels_[ch];
+
+    switch (ch) {
+    case SQUARE1:
+    case SQUARE2:
+        c.position = (c.position + 1) & 0x07;
+        break;
+    case WAVE:
+        c.position = (c.position + 1) & 0x1f;
+        break;
+    default: {
+        auto bit = (c.lfsr ^ (c.lfsr >> 1)) & 1;
+        c.lfsr = static_cast<uint16_t>((c.lfsr >> 1) | bit << 14);
+        if (reg(nr43_address) & 0x08)
+            c.lfsr = static_cast<uint16_t>((c.lfsr & ~0x40) | bit << 6);
+        break;
+    }
+    }
+}
+
+void Apu::step_sequencer()
+{
+    auto step = sequencer_step_;
+    sequencer_step_ = (sequencer_step_ + 1) & 0x07;
+
+    if (!(step & 1)) {
+        for (auto &c : channels_)
+            if (c.length_enabled && c.length && !--c.length)
+                c.enabled = false;
+    }
+
+    if (step == 2 || step == 6)
+        step_sweep();
+
+    if (step == 7) {
+        for (int ch = 0; ch < num_channels; ++ch) {
+            auto &c = channels_[ch];
+            if (ch == WAVE || !c.envelope_period || --c.envelope_timer)
+                continue;
+
+            c.envelope_timer = c.envelope_period;
+            if (c.envelope_up && c.volume < 15)
+                ++c.volume;
+            else if (!c.envelope_up && c.volume > 0)
+                --c.volume;
+        }
+    }
+
+    output_all();
+}
+
+void Apu::step_sweep()
+{
+    if (sweep_timer_ && --sweep_timer_)
+        return;
+
+    auto nr10 = reg(nr10_address);
+    auto sweep_period = nr10 >> 4 & 0x07;
+    sweep_timer_ = sweep_period ? sweep_period : 8;
+
+    if (!sweep_enabled_ || !sweep_period)
+        return;
+
+    uint16_t frequency;
+    if (sweep_overflows(frequency) || !(nr10 & 0x07))
+        return;
+
+    sweep_shadow_ = frequency;
+    channels_[SQUARE1].frequency = frequency;
+    registers_[channel_register(SQUARE1, 3) - first_address] = frequency & 0xff;
+    auto &nr14 = registers_[channel_register(SQUARE1, 4) - first_address];
+    nr14 = static_cast<uint8_t>((nr14 & ~0x07) | frequency >> 8);
+
+    sweep_overflows(frequency);
+}
+
+bool Apu::sweep_overflows(uint16_t &frequency)
+{
+    auto nr10 = reg(nr10_address);
+    auto delta = sweep_shadow_ >> (nr10 & 0x07);
+    auto result = (nr10 & 0x08) ? sweep_shadow_ - delta : sweep_shadow_ + delta;
+
+    if (result > 0x7ff) {
+        channels_[SQUARE1].enabled = false;
+        return true;
+    }
+
+    frequency = static_cast<uint16_t>(result);
+    return false;
+}
+
+void Apu::trigger(int ch)
+{
+    auto &c = channels_[ch];
+
+    c.enabled = c.dac;
+    if (!c.length)
+        c.length = ch == WAVE ? 0x100 : 0x40;
+
+    if (ch != WAVE) {
+        auto envelope = reg(channel_register(ch, 2));
+        c.volume = envelope >> 4;
+        c.envelope_up = envelope & 0x08;
+        c.envelope_period = envelope & 0x07;
+        c.envelope_timer = c.envelope_period;
+    }
+
+    if (ch == WAVE)
+        c.position = 0;
+    if (ch == NOISE)
+        c.lfsr = 0x7fff;
+
+    auto p = period(ch);
+    c.next = p == never ? never : time_ + p;
+
+    if (ch == SQUARE1) {
+        auto nr10 = reg(nr10_address);
+        sweep_shadow_ = c.frequency;
+        sweep_timer_ = (nr10 >> 4 & 0x07) ? (nr10 >> 4 & 0x07) : 8;
+        sweep_enabled_ = nr10 & 0x77;
+
+        uint16_t frequency;
+        if (nr10 & 0x07)
+            sweep_overflows(frequency);
+    }
+}
+
+void Apu::output(int ch, unsigned long time)
+{
+    if (!synthesis_)
+        return;
+
+    auto &c = channels_[ch];
+    auto l = level(ch);
+    auto nr50 = reg(nr50_address);
+    auto nr51 = reg(nr51_address);
+
+    auto left = (nr51 & 0x10 << ch) ? amplitude * l * ((nr50 >> 4 & 0x07) + 1) : 0;
+    auto right = (nr51 & 0x01 << ch) ? amplitude * l * ((nr50 & 0x07) + 1) : 0;
+
+    if (left != c.left || right != c.right) {
+        synth_.add_delta(time, left - c.left, right - c.right);
+        c.left = left;
+        c.right = right;
+    }
+}
+
+void Apu::output_all()
+{
+    for (int ch = 0; ch < num_channels; ++ch)
+        output(ch, time_);
+}
+
+void Apu::power_off()
+{
+    fill(registers_.begin(), registers_.begin() + (wave_address - first_address), 0);
+    for (auto &c : channels_) {
+        c.enabled = false;
+        c.dac = false;
+        c.length_enabled = false;
+        c.next = never;
+    }
+    sweep_enabled_ = false;
+    output_all();
+}
+
+}
@@ -0,0 +1,159 @@
+#ifndef APU_HPP_
+#define APU_HPP_
+
+#include <array>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+
+#include "ring_buffer.hpp"
+#include "synth.hpp"
+
+namespace mjkgb {
+
+struct GameboyImpl;
+class Mmu;
+class Scheduler;
+class StateReader;
+class StateWriter;
+
+/* Sound unit. Nothing is done per tick, instead the channels are brought up to
+ * date whenever one of the sound registers is accessed, and periodically by
+ * a scheduled event. Catching up walks each channel's waveform steps and frame
+ * sequencer steps in order, handing every change in output level to the Synth.
+ *
+ * Internally time is measured in 2 MHz units, as that is the finest
+ * resolution any of the channel timers need.
+ *
+ * With synthesis disabled only the frame sequencer is run, so length, sweep
+ * and envelope state as seen by the game stay correct but no samples are made.
+ */
+class Apu {
+public:
+    static constexpr uint16_t first_address = 0xff10;
+    static constexpr uint16_t last_address = 0xff3f;
+    static constexpr uint16_t nr52_address = 0xff26;
+    static constexpr uint16_t wave_address = 0xff30;
+
+    static constexpr unsigned long apu_rate = 1 << 21;
+    static constexpr unsigned default_sample_rate = 48000;
+
+    /* Sample rates outside this range are clamped to it */
+    static constexpr unsigned min_sample_rate = 8000;
+    static constexpr unsigned max_sample_rate = 192000;
+
+    /* Samples are handed to the output buffer at least this often */
+    static constexpr unsigned long update_cycles = 17556;
+
+    Apu();
+
+    void update(GameboyImpl &gb, unsigned long clock);
+
+    /* Clock of the first frame sequencer step after clock */
+    unsigned long next_sequencer_clock(unsigned long clock) const;
+
+    uint8_t read(GameboyImpl &gb, uint16_t address);
+    void write(GameboyImpl &gb, uint16_t address, uint8_t value);
+
+    inline size_t read_samples(int16_t *data, size_t count)
+    {
+        return output_.read(data, count);
+    }
+
+    inline size_t available() const
+    {
+        return output_.size();
+    }
+
+    inline unsigned sample_rate() const
+    {
+        return synth_.rate();
+    }
+
+    inline bool synthesis() const
+    {
+        return synthesis_;
+    }
+
+    void set_sample_rate(unsigned rate);
+    void set_synthesis(bool enabled);
+
+    void reset(GameboyImpl &gb);
+
+    /* Synthesis state isn't saved, output restarts from silence */
+    void save_state(StateWriter &state) const;
+    void load_state(StateReader &state);
+
+    void attach(Mmu &mmu, Scheduler &scheduler);
+
+private:
+    static constexpr unsigned long never = ULONG_MAX;
+    static constexpr unsigned long sequencer_period = 4096;
+
+    /* Samples the synth can hold, at least a frame sequencer step's worth at
+     * the highest sample rate
+     */
+    static constexpr size_t synth_capacity = 1024;
+    static_assert(max_sample_rate * sequencer_period / apu_rate < synth_capacity,
+            "the synth must hold a frame sequencer step at any sample rate");
+    static constexpr int num_channels = 4;
+
+    enum ChannelId {
+        SQUARE1, SQUARE2, WAVE, NOISE
+    };
+
+    struct Channel {
+        bool enabled;
+        bool dac;
+        bool length_enabled;
+        unsigned length;
+        uint8_t volume;
+        uint8_t envelope_period;
+        uint8_t envelope_timer;
+        bool envelope_up;
+        uint16_t frequency;
+        unsigned position;
+        uint16_t lfsr;
+        unsigned long next;
+        int left;
+        int right;
+    };
+
+    unsigned long period(int ch) const;
+    int level(int ch) const;
+
+    void run_channels(unsigned long until);
+    void step_channel(int ch);
+    void step_sequencer();
+    void step_sweep();
+    bool sweep_overflows(uint16_t &frequency);
+    void trigger(int ch);
+    void output(int ch, unsigned long time);
+    void output_all();
+    void power_off();
+
+    inline uint8_t reg(uint16_t address) const
+    {
+        return registers_[address - first_address];
+    }
+
+    std::array<uint8_t, last_address - first_address + 1> registers_;
+    std::array<Channel, num_channels> channels_;
+
+    bool power_;
+    bool synthesis_;
+    unsigned long time_;
+    unsigned long next_sequencer_;
+    unsigned sequencer_step_;
+
+    bool sweep_enabled_;
+    uint8_t sweep_timer_;
+    uint16_t sweep_shadow_;
+
+    Synth synth_;
+    RingBuffer<int16_t> output_;
+};
+
+}
+
+#endif /* APU_HPP_ */
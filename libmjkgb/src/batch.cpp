@@ -0,0 +1,58 @@
+#include <utility>
+
+#include "mjkgb.hpp"
+#include "batch_impl.hpp"
+
+namespace mjkgb {
+
+using namespace std;
+
+Batch::Batch(const Gameboy &prototype, size_t count, unsigned threads)
+  : pimpl_(new Batch::impl(prototype, count, threads))
+{ }
+
+Batch::~Batch()
+{ }
+
+size_t Batch::size() const
+{
+    return pimpl_->machines_.size();
+}
+
+Gameboy &Batch::operator[](size_t index)
+{
+    return *pimpl_->machines_[index];
+}
+
+void Batch::setInputCallback(input_cb callback)
+{
+    pimpl_->input_ = move(callback);
+}
+
+void Batch::setRamOutput(uint16_t address, size_t size)
+{
+    pimpl_->ram_address_ = address;
+    pimpl_->ram_size_ = size;
+    pimpl_->ram_.assign(size * pimpl_->machines_.size(), 0);
+}
+
+const uint8_t *Batch::ram(size_t index) const
+{
+    return pimpl_->ram_.data() + index * pimpl_->ram_size_;
+}
+
+void Batch::runCycles(unsigned long cycles)
+{
+    pimpl_->run([cycles](GameboyImpl &gb) {
+        gb.run_until(gb.cpu_.get_clock() + cycles);
+    });
+}
+
+void Batch::runFrame()
+{
+    pimpl_->run([](GameboyImpl &gb) {
+        gb.run_frame();
+    });
+}
+
+}
@@ -0,0 +1,69 @@
+#ifndef BATCH_IMPL_HPP_
+#define BATCH_IMPL_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "mjkgb.hpp"
+#include "gameboy_impl.hpp"
+#include "thread_pool.hpp"
+
+namespace mjkgb {
+
+/* Clones of the prototype and the pool they run on. VectorEnv is built on
+ * the same, stepping machines its own way through each().
+ */
+class Batch::impl {
+public:
+    impl(const Gameboy &prototype, size_t count, unsigned threads)
+      : pool_(threads),
+        machines_(),
+        input_(),
+        ram_address_(0),
+        ram_size_(0),
+        ram_()
+    {
+        for (size_t i = 0; i < count; ++i)
+            machines_.push_back(prototype.clone());
+    }
+
+    /* Call func with the index of each machine and the machine, in parallel,
+     * returning once all calls have
+     */
+    template<typename Func>
+    void each(Func func)
+    {
+        pool_.run(machines_.size(), [&](size_t index) {
+            func(index, *machines_[index]);
+        });
+    }
+
+    /* Each machine runs to its own target, machines needn't be in step */
+    template<typename Step>
+    void run(Step step)
+    {
+        each([&](size_t index, Gameboy &gb) {
+            if (input_)
+                input_(index, gb);
+
+            auto &machine = *gb.pimpl_;
+            step(machine);
+
+            machine.mmu_.peek(ram_address_, &ram_[index * ram_size_], ram_size_);
+        });
+    }
+
+    ThreadPool pool_;
+    std::vector<std::unique_ptr<Gameboy>> machines_;
+    input_cb input_;
+
+    uint16_t ram_address_;
+    size_t ram_size_;
+    std::vector<uint8_t> ram_;
+};
+
+}
+
+#endif /* BATCH_IMPL_HPP_ */
@@ -0,0 +1,426 @@
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <iterator>
+#include <map>
+#include <set>
+
+#include <dlfcn.h>
+#include <link.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "code_cache.hpp"
+#include "mmu.hpp"
+#include "perf_map.hpp"
+
+/* Driver linking modules of blocks compiled at run time, normally the C
+ * compiler libmjkgb was built with
+ */
+#ifndef MJKGB_LINKER
+#define MJKGB_LINKER "cc"
+#endif
+
+namespace mjkgb {
+
+using namespace std;
+
+namespace {
+
+/* "MJKJ" */
+constexpr uint32_t file_magic = 0x4a4b4a4d;
+
+mutex caches_mutex;
+map<uint64_t, weak_ptr<CodeCache>> caches;
+string cache_directory;
+map<uint64_t, const PrecompiledModule *> modules;
+
+/* Modules whose blocks are in the perf map */
+mutex named_mutex;
+set<const PrecompiledModule *> named;
+
+template<typename T>
+void write(ostream &os, T value)
+{
+    for (size_t i = 0; i < sizeof(T); ++i)
+        os.put(static_cast<char>(value >> (8 * i)));
+}
+
+template<typename T>
+bool read_value(istream &is, T &value)
+{
+    value = 0;
+    for (size_t i = 0; i < sizeof(T); ++i) {
+        auto byte = is.get();
+        if (byte == char_traits<char>::eof())
+            return false;
+        value |= static_cast<T>(static_cast<T>(byte) << (8 * i));
+    }
+    return true;
+}
+
+/* Link object into a shared module at path, as mjkgb_precompile does */
+bool link(const string &object, const string &path)
+{
+    const char *argv[] = { MJKGB_LINKER, "-shared", "-o", path.c_str(), object.c_str(), nullptr };
+    pid_t pid;
+    if (posix_spawnp(&pid, argv[0], nullptr, nullptr, const_cast<char *const *>(argv), environ))
+        return false;
+
+    int status;
+    return waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+/* Add the blocks of a module to the perf map, if enabled, under their symbols
+ * in the module. perf reads those itself for samples in the module, but
+ * other tools only look at the map.
+ */
+void name_blocks(const PrecompiledModule &module)
+{
+    auto perf = PerfMap::get();
+    if (!perf)
+        return;
+
+    lock_guard<mutex> lock{named_mutex};
+    if (!named.insert(&module).second)
+        return;
+
+    for (uint64_t i = 0; i < module.count; ++i) {
+        auto native = module.blocks[i].native;
+        Dl_info info;
+        void *symbol = nullptr;
+        if (dladdr1(native, &info, &symbol, RTLD_DL_SYMENT) && symbol && info.dli_sname)
+            perf->add(reinterpret_cast<uintptr_t>(native),
+                    static_cast<const ElfW(Sym) *>(symbol)->st_size, info.dli_sname);
+    }
+}
+
+/* A new empty file named path followed by a unique part and suffix */
+string temporary(const string &path, const string &suffix)
+{
+    auto name = path + ".XXXXXX" + suffix;
+    auto fd = mkstemps(&name[0], static_cast<int>(suffix.size()));
+    if (fd < 0)
+        return string{};
+    close(fd);
+    return name;
+}
+
+}
+
+shared_ptr<CodeCache> CodeCache::get(uint64_t hash)
+{
+    lock_guard<mutex> lock{caches_mutex};
+
+    auto &cache = caches[hash];
+    auto shared = cache.lock();
+    if (!shared) {
+        auto module = modules.find(hash);
+        shared = make_shared<CodeCache>(hash, cache_directory,
+                module == modules.end() ? nullptr : module->second);
+        cache = shared;
+    }
+
+    /* Forget ROMs which are no longer running */
+    for (auto it = caches.begin(); it != caches.end(); )
+        it = it->second.expired() ? caches.erase(it) : next(it);
+
+    return shared;
+}
+
+uint64_t CodeCache::hash(const Mmu &mmu)
+{
+    uint64_t hash = 0xcbf29ce484222325;
+    for (uint16_t address = 0; address < Jit::rom_end; ++address) {
+        hash ^= mmu.peek(address);
+        hash *= 0x100000001b3;
+    }
+    return hash;
+}
+
+void CodeCache::set_directory(const string &directory)
+{
+    lock_guard<mutex> lock{caches_mutex};
+    cache_directory = directory;
+}
+
+bool CodeCache::load_module(const string &path)
+{
+    auto module = open_module(path);
+    if (!module)
+        return false;
+
+    lock_guard<mutex> lock{caches_mutex};
+    modules[module->rom_hash] = module;
+
+    auto cache = caches.find(module->rom_hash);
+    if (cache != caches.end())
+        if (auto shared = cache->second.lock())
+            shared->publish(*module);
+    return true;
+}
+
+CodeCache::CodeCache(uint64_t hash, const string &directory, const PrecompiledModule *module)
+  : hash_(hash),
+    entries_(),
+    owned_(),
+    branches_(),
+    loaded_(),
+    mutex_(),
+    precompiled_cv_(),
+    precompiled_(true),
+    compiler_(),
+    file_(),
+    stop_(false),
+    thread_()
+{
+    for (auto &entry : entries_)
+        entry.store(nullptr);
+
+    if (module)
+        publish(*module);
+
+    if (directory.empty())
+        return;
+
+    char name[64];
+    snprintf(name, sizeof(name), "/%016" PRIx64 "-%016" PRIx64, hash, Compiler::version());
+    auto base = directory + name;
+    auto path = base + ".jit";
+
+    block_list blocks;
+    if (read(path, blocks)) {
+        file_.open(path, ios::binary | ios::app);
+    } else {
+        file_.open(path, ios::binary | ios::trunc);
+        write(file_, file_magic);
+        write(file_, Compiler::version());
+        file_.flush();
+    }
+
+    /* Blocks are only recorded once published, and the module's are
+     * published, so a file listing more blocks has some the module lacks
+     */
+    uint64_t saved = 0;
+    auto module_path = base + ".so";
+    if (auto saved_module = open_module(module_path)) {
+        if (saved_module->rom_hash == hash) {
+            publish(*saved_module);
+            saved = saved_module->count;
+        }
+    }
+
+    if (blocks.size() > saved) {
+        precompiled_ = false;
+        thread_ = thread{&CodeCache::precompile, this, move(module_path), move(blocks)};
+    }
+}
+
+CodeCache::~CodeCache()
+{
+    stop_ = true;
+    if (thread_.joinable())
+        thread_.join();
+}
+
+const CodeCache::Entry *CodeCache::find(const Mmu &mmu, uint16_t address) const
+{
+    auto entry = entries_[address].load(memory_order_acquire);
+    if (!entry || !matches(*entry, mmu, address))
+        return nullptr;
+    return entry;
+}
+
+const CodeCache::Entry *CodeCache::compile(const Mmu &mmu, uint16_t address)
+{
+    auto block = Jit::decode(mmu, address);
+
+    lock_guard<mutex> lock{mutex_};
+
+    auto published = entries_[address].load(memory_order_relaxed);
+    if (published && published->block == block)
+        return published;
+
+    return add(address, move(block));
+}
+
+const CodeCache::Entry *CodeCache::optimize(const Mmu &mmu, uint16_t address)
+{
+    lock_guard<mutex> lock{mutex_};
+
+    auto &published = entries_[address];
+    auto current = published.load(memory_order_relaxed);
+    auto same = current && matches(*current, mmu, address);
+    if (same && current->optimized)
+        return current;
+
+    bool loops;
+    auto trace = Jit::trace(mmu, address, branches_.get(), loops);
+    auto native = compiler_.compile_trace(trace, loops);
+    if (!native)
+        return nullptr;
+
+    auto block = move(trace.front().second);
+    trace.erase(trace.begin());
+    owned_.emplace_back(new Entry{native, move(block), true, move(trace)});
+    if (!current || same)
+        published.store(owned_.back().get(), memory_order_release);
+    return owned_.back().get();
+}
+
+size_t CodeCache::size() const
+{
+    lock_guard<mutex> lock{mutex_};
+    return owned_.size();
+}
+
+void CodeCache::install(Mmu &mmu) const
+{
+    lock_guard<mutex> lock{mutex_};
+    for (auto address : loaded_)
+        if (auto entry = find(mmu, address))
+            mmu.set_native(address, entry->native);
+}
+
+void CodeCache::wait()
+{
+    unique_lock<mutex> lock{mutex_};
+    precompiled_cv_.wait(lock, [this] { return precompiled_; });
+}
+
+bool CodeCache::read(const string &path, block_list &blocks)
+{
+    ifstream is{path, ios::binary};
+    uint32_t magic;
+    uint64_t version;
+    if (!read_value(is, magic) || magic != file_magic ||
+            !read_value(is, version) || version != Compiler::version())
+        return false;
+
+    /* A partly written last entry is ignored */
+    uint16_t address;
+    uint8_t size;
+    while (read_value(is, address) && read_value(is, size)) {
+        vector<uint8_t> block(size);
+        if (!is.read(reinterpret_cast<char *>(block.data()), size))
+            break;
+        blocks.emplace_back(address, move(block));
+    }
+    return true;
+}
+
+const PrecompiledModule *CodeCache::open_module(const string &path)
+{
+    /* Never unloaded, as machines may be running its code at any time */
+    auto handle = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (!handle)
+        return nullptr;
+
+    auto module = static_cast<const PrecompiledModule *>(dlsym(handle, precompiled_symbol));
+    if (!module || module->version != Compiler::version()) {
+        dlclose(handle);
+        return nullptr;
+    }
+
+    name_blocks(*module);
+    return module;
+}
+
+void CodeCache::precompile(string path, block_list blocks)
+{
+    /* The last block recorded at each address within ROM */
+    map<uint16_t, vector<uint8_t>> unique;
+    for (auto &block : blocks)
+        if (block.first < Jit::rom_end)
+            unique[block.first] = move(block.second);
+    blocks.assign(make_move_iterator(unique.begin()), make_move_iterator(unique.end()));
+
+    /* Built under names of its own, without mutex_, so machines carry on
+     * meanwhile. The dynamic loader hands back what it already has for a
+     * path, so the module is loaded from where it was linked and only then
+     * moved into place.
+     */
+    auto object = temporary(path, ".o");
+    auto linked = temporary(path, ".so");
+    if (!object.empty() && !linked.empty() &&
+            Compiler::emit(object, hash_, blocks) && !stop_ && link(object, linked)) {
+        if (auto module = open_module(linked)) {
+            publish(*module);
+            if (!rename(linked.c_str(), path.c_str()))
+                linked.clear();
+        }
+    }
+    if (!object.empty())
+        unlink(object.c_str());
+    if (!linked.empty())
+        unlink(linked.c_str());
+
+    {
+        lock_guard<mutex> lock{mutex_};
+        precompiled_ = true;
+    }
+    precompiled_cv_.notify_all();
+}
+
+bool CodeCache::matches(const Entry &entry, const Mmu &mmu, uint16_t address)
+{
+    if (entry.block != Jit::decode(mmu, address))
+        return false;
+    for (const auto &segment : entry.tail)
+        if (segment.second != Jit::decode(mmu, segment.first))
+            return false;
+    return true;
+}
+
+void CodeCache::publish(const PrecompiledModule &module)
+{
+    lock_guard<mutex> lock{mutex_};
+    for (uint64_t i = 0; i < module.count; ++i) {
+        const auto &block = module.blocks[i];
+        if (block.address >= Jit::rom_end)
+            continue;
+
+        /* Optimized ahead of time, so better than anything but another
+         * optimized block
+         */
+        auto &published = entries_[block.address];
+        auto current = published.load(memory_order_relaxed);
+        if (current && current->optimized)
+            continue;
+
+        owned_.emplace_back(new Entry{reinterpret_cast<uintptr_t>(block.native),
+                vector<uint8_t>(block.opcodes, block.opcodes + block.size), true, {}});
+        published.store(owned_.back().get(), memory_order_release);
+        loaded_.push_back(block.address);
+    }
+}
+
+const CodeCache::Entry *CodeCache::add(uint16_t address, vector<uint8_t> block)
+{
+    if (!branches_)
+        branches_.reset(new BranchCounts[Jit::rom_end + 3]());
+    auto native = compiler_.compile(address, block, Compiler::Tier::BASELINE, branches_.get());
+    if (!native)
+        return nullptr;
+
+    /* Code for a modified ROM stays private to the machine that asked */
+    auto &published = entries_[address];
+    if (!published.load(memory_order_relaxed)) {
+        if (file_) {
+            write(file_, address);
+            write(file_, static_cast<uint8_t>(block.size()));
+            file_.write(reinterpret_cast<const char *>(block.data()),
+                    static_cast<streamsize>(block.size()));
+            file_.flush();
+        }
+        owned_.emplace_back(new Entry{native, move(block), false, {}});
+        published.store(owned_.back().get(), memory_order_release);
+    } else {
+        owned_.emplace_back(new Entry{native, move(block), false, {}});
+    }
+
+    return owned_.back().get();
+}
+
+}
@@ -0,0 +1,166 @@
+#ifndef CODE_CACHE_HPP_
+#define CODE_CACHE_HPP_
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "compiler.hpp"
+#include "jit.hpp"
+
+namespace mjkgb {
+
+class Mmu;
+
+/* Compiled code shared by every machine in the process running the same ROM.
+ * There is one cache per ROM hash, alive for as long as any machine holds it,
+ * which owns the compiler and with it the machine code. A block compiled by
+ * any machine is published under its address, and other machines install it
+ * into their own native tables the next time they jump there.
+ *
+ * There's no bank switching, so the address alone identifies a block within
+ * a ROM. Each entry also keeps the instructions it was compiled from, so a
+ * machine whose ROM area has since been written doesn't pick up the wrong
+ * code.
+ *
+ * With a cache directory set, every block compiled is also appended to a
+ * file named after the ROM hash and compiler version. When a cache is next
+ * created for that ROM, a helper thread compiles everything in the file
+ * ahead of time into a module, as mjkgb_aot does, and publishes its blocks,
+ * so machines find hot code already there rather than each having to warm up
+ * to it. The module is kept next to the file, and later caches load it
+ * straight away, only building another once the file lists blocks it lacks.
+ *
+ * Blocks can also come from a module compiled ahead of time by mjkgb_aot.
+ * These are published as soon as the cache exists, and installed into each
+ * machine's native table when it loads the ROM, so they run even with the
+ * JIT disabled.
+ */
+class CodeCache {
+public:
+    /* The cache for ROM with the given hash, created if no machine has it */
+    static std::shared_ptr<CodeCache> get(uint64_t hash);
+
+    /* FNV-1a over the ROM area */
+    static uint64_t hash(const Mmu &mmu);
+
+    /* Directory for block files of caches created from now on, or empty to
+     * stop using one
+     */
+    static void set_directory(const std::string &directory);
+
+    /* Load a module of blocks compiled ahead of time, for caches of its ROM.
+     * Returns false if it can't be loaded or is from a different compiler.
+     */
+    static bool load_module(const std::string &path);
+
+    struct Entry {
+        uintptr_t native;
+        std::vector<uint8_t> block;
+        bool optimized;
+
+        /* Blocks after the first, for traces */
+        Compiler::block_list tail;
+    };
+
+    CodeCache(uint64_t hash, const std::string &directory,
+            const PrecompiledModule *module = nullptr);
+    ~CodeCache();
+
+    CodeCache(const CodeCache &) = delete;
+    CodeCache &operator=(const CodeCache &) = delete;
+
+    inline uint64_t rom_hash() const
+    {
+        return hash_;
+    }
+
+    /* Published code for the block at address, if it matches mmu's */
+    const Entry *find(const Mmu &mmu, uint16_t address) const;
+
+    /* Compile the block at address at the baseline tier and publish it,
+     * unless another machine already has. Null if it can't be compiled.
+     */
+    const Entry *compile(const Mmu &mmu, uint16_t address);
+
+    /* Recompile the block at address at the optimized tier, as a trace
+     * following the branch counts gathered by its baseline code. This
+     * replaces the published baseline code for machines which look it up
+     * from then on, and baseline code stays valid for those still running it.
+     */
+    const Entry *optimize(const Mmu &mmu, uint16_t address);
+
+    /* Number of blocks compiled through or loaded into this cache */
+    size_t size() const;
+
+    /* Set native code for every block compiled ahead of time that matches
+     * mmu's ROM
+     */
+    void install(Mmu &mmu) const;
+
+    /* Wait for the helper to finish compiling the blocks read from file */
+    void wait();
+
+private:
+    using block_list = Compiler::block_list;
+
+    /* Blocks in the file at path, false if it isn't a valid block file */
+    static bool read(const std::string &path, block_list &blocks);
+
+    /* The table of the module at path, or null if it can't be loaded or is
+     * from a different compiler
+     */
+    static const PrecompiledModule *open_module(const std::string &path);
+
+    /* Build a module of blocks, load it and publish its blocks, then move it
+     * to path for later caches. Runs on the helper thread.
+     */
+    void precompile(std::string path, block_list blocks);
+    void publish(const PrecompiledModule &module);
+
+    /* Whether every block of entry still matches mmu */
+    static bool matches(const Entry &entry, const Mmu &mmu, uint16_t address);
+
+    /* Compile a block and publish it if nothing is there yet, with mutex_
+     * held. Published blocks are recorded in the file.
+     */
+    const Entry *add(uint16_t address, std::vector<uint8_t> block);
+
+    uint64_t hash_;
+
+    /* Entries are only added, under mutex_, and never change once
+     * published, so lookups need no lock. A published entry is only ever
+     * replaced by an optimized one, and the old one is kept.
+     */
+    std::array<std::atomic<const Entry *>, Jit::rom_end> entries_;
+    std::vector<std::unique_ptr<Entry>> owned_;
+
+    /* Counts for baseline code, indexed by the address after the branch,
+     * which can be up to an instruction past the end of ROM
+     */
+    std::unique_ptr<BranchCounts[]> branches_;
+
+    /* Addresses of blocks loaded from a module */
+    std::vector<uint16_t> loaded_;
+    mutable std::mutex mutex_;
+    std::condition_variable precompiled_cv_;
+    bool precompiled_;
+
+    Compiler compiler_;
+
+    std::ofstream file_;
+    std::atomic<bool> stop_;
+    std::thread thread_;
+};
+
+}
+
+#endif /* CODE_CACHE_HPP_ */
@@ -1,6 +1,10 @@
 #include <array>
 #include <cstdint>
+#include <cstdio>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <string>
 #include <vector>
 
 #include <llvm/LinkAllIR.h>
@@ -9,20 +13,36 @@
 #include <llvm/Bitcode/ReaderWriter.h>
 #include <llvm/ExecutionEngine/ExecutionEngine.h>
 #include <llvm/ExecutionEngine/JIT.h>
+#include <llvm/ExecutionEngine/JITEventListener.h>
 #include <llvm/IR/BasicBlock.h>
+#include <llvm/IR/Constants.h>
 #include <llvm/IR/DataLayout.h>
 #include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Instructions.h>
 #include <llvm/IR/LLVMContext.h>
 #include <llvm/IR/DerivedTypes.h>
 #include <llvm/IR/Function.h>
+#include <llvm/IR/GlobalVariable.h>
 #include <llvm/IR/Module.h>
 #include <llvm/IR/LegacyPassManager.h>
 #include <llvm/IR/Type.h>
 #include <llvm/Support/ErrorOr.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/FormattedStream.h>
+#include <llvm/Support/Host.h>
 #include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/TargetRegistry.h>
+#include <llvm/Support/TargetSelect.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Target/TargetMachine.h>
+#include <llvm/Target/TargetOptions.h>
 #include <llvm/Transforms/IPO.h>
+#include <llvm/Transforms/Utils/Cloning.h>
 
 #include "compiler.hpp"
+#include "jit.hpp"
+#include "mmu.hpp"
+#include "perf_map.hpp"
 
 namespace mjkgb {
 
@@ -33,91 +53,545 @@ using namespace llvm::legacy;
 extern "C" const char _binary_opcodes_bc_start[];
 extern "C" const char _binary_opcodes_bc_end[];
 
-class Compiler::impl {
-public:
-    impl()
-      : opcodes_(),
-        context_(),
-        pm_(),
-        mod_(nullptr),
-        ee_(nullptr),
-        gb_type_(nullptr),
-        gb_type_ptr_(nullptr),
-        opcode_type_(nullptr)
-    {
-        LLVMInitializeNativeTarget();
-        size_t size = _binary_opcodes_bc_end - _binary_opcodes_bc_start;
-        auto buffer = MemoryBuffer::getMemBuffer(StringRef{_binary_opcodes_bc_start, size}, "", false);
-
-        mod_ = parseBitcodeFile(buffer, context_).get();
-        ee_ = EngineBuilder(mod_).create();
-
-        gb_type_ = mod_->getTypeByName("struct.mjkgb::GameboyImpl");
-        gb_type_ptr_ = PointerType::getUnqual(gb_type_);
-        opcode_type_= FunctionType::get(Type::getVoidTy(context_), { gb_type_ptr_ }, false);
-
-        pm_.add(createVerifierPass());
-        pm_.add(createCFGSimplificationPass());
-        pm_.add(createPromoteMemoryToRegisterPass());
-        pm_.add(createGlobalOptimizerPass());
-        pm_.add(createGlobalDCEPass());
-        pm_.add(createFunctionInliningPass());
-        pm_.add(createStripSymbolsPass());
-
-        opcodes_ = {
-#define X(name, def, is_jump, cycles) mod_->getFunction(#name),
+namespace {
+
+Module *parse_opcodes(LLVMContext &context)
+{
+    size_t size = _binary_opcodes_bc_end - _binary_opcodes_bc_start;
+    auto buffer = MemoryBuffer::getMemBuffer(StringRef{_binary_opcodes_bc_start, size}, "", false);
+    return parseBitcodeFile(buffer, context).get();
+}
+
+array<Function *, 512> opcode_functions(Module &mod)
+{
+    return {{
+#define X(name, def, is_jump, cycles) mod.getFunction(#name),
+#include "opcode_map.in"
+#include "cb_opcode_map.in"
+#undef X
+    }};
+}
+
+/* How a block shows up in profiles: the bank and address of its start, as a
+ * debugger would show them, then its opcodes
+ */
+string describe(uint16_t address, const vector<uint8_t> &block)
+{
+    static const char *const names[] = {
+#define X(name, def, is_jump, cycles) #name,
 #include "opcode_map.in"
 #include "cb_opcode_map.in"
 #undef X
-        };
+    };
+
+    char start[8];
+    snprintf(start, sizeof(start), "%02x:%04x", Mmu::bank(address), address);
+    string description{start};
+    for (size_t i = 0; i < block.size(); i += Jit::length(block[i])) {
+        description += ' ';
+        description += names[block[i] == 0xcb ? 256 + block[i + 1] : block[i]];
+    }
+    return description;
+}
+
+FunctionType *block_type(Module &mod)
+{
+    auto gb_type = mod.getTypeByName("struct.mjkgb::GameboyImpl");
+    return FunctionType::get(Type::getVoidTy(mod.getContext()), { PointerType::getUnqual(gb_type) }, false);
+}
+
+void add_passes(PassManager &pm)
+{
+    pm.add(createVerifierPass());
+    pm.add(createCFGSimplificationPass());
+    pm.add(createPromoteMemoryToRegisterPass());
+    pm.add(createGlobalOptimizerPass());
+    pm.add(createGlobalDCEPass());
+    pm.add(createFunctionInliningPass());
+
+    /* Once inlined, each opcode's register and flag writes mostly feed
+     * straight into the next opcode's reads
+     */
+    pm.add(createSROAPass());
+    pm.add(createEarlyCSEPass());
+    pm.add(createInstructionCombiningPass());
+    pm.add(createGVNPass());
+    pm.add(createDeadStoreEliminationPass());
+    pm.add(createCFGSimplificationPass());
+
+    pm.add(createStripSymbolsPass());
+}
+
+/* What's left to simplify once immediates have been folded in */
+void add_cleanup_passes(legacy::PassManagerBase &pm)
+{
+    pm.add(createInstructionCombiningPass());
+    pm.add(createGVNPass());
+    pm.add(createDeadStoreEliminationPass());
+    pm.add(createCFGSimplificationPass());
+}
+
+/* Replace the reads of immediates at addresses the optimizer has worked out
+ * with the bytes from blocks, returning whether there were any. An immediate
+ * used as an address then makes the memory access one at a known address.
+ */
+bool fold_immediates(Function &func, Function *immediate, const Compiler::block_list &blocks)
+{
+    auto folded = false;
+    for (auto &bb : func) {
+        for (auto it = bb.begin(); it != bb.end(); ) {
+            auto call = dyn_cast<CallInst>(&*it++);
+            if (!call || call->getCalledFunction() != immediate)
+                continue;
+            auto address = dyn_cast<ConstantInt>(call->getArgOperand(1));
+            if (!address)
+                continue;
+
+            for (const auto &block : blocks) {
+                auto offset = address->getZExtValue() - block.first;
+                if (offset < block.second.size()) {
+                    call->replaceAllUsesWith(ConstantInt::get(call->getType(), block.second[offset]));
+                    call->eraseFromParent();
+                    folded = true;
+                    break;
+                }
+            }
+        }
+    }
+    return folded;
+}
+
+/* Branch to body if the block can run for cycles before the next event, and
+ * to exit otherwise
+ */
+void check_budget(IRBuilder<> &builder, Value *gb, unsigned cycles, BasicBlock *body,
+        BasicBlock *exit)
+{
+    auto budget = builder.GetInsertBlock()->getParent()->getParent()->getFunction("jit_budget");
+    auto result = builder.CreateCall2(budget, gb,
+            ConstantInt::get(Type::getInt32Ty(builder.getContext()), cycles));
+    builder.CreateCondBr(builder.CreateICmpNE(result, ConstantInt::get(result->getType(), 0)),
+            body, exit);
+}
+
+/* Calls to the opcode functions for each instruction of block in turn,
+ * returning the last instruction's opcode and the address following it.
+ * With pin set, each instruction first sets PC to its address, for code to
+ * be optimized.
+ *
+ * An instruction which can schedule an event, such as EI or a write to IF,
+ * may bring the next event forward into the rest of the block. After those
+ * the budget is checked again for what remains, leaving for exit if it no
+ * longer fits, so that the dispatch loop takes the event at the same
+ * instruction as without compiled code.
+ */
+uint8_t call_opcodes(IRBuilder<> &builder, const array<Function *, 512> &opcodes,
+        Value *gb, uint16_t address, const vector<uint8_t> &block, bool pin,
+        BasicBlock *exit, unsigned &next)
+{
+    auto &context = builder.getContext();
+    auto func = builder.GetInsertBlock()->getParent();
+    auto at = func->getParent()->getFunction("jit_at");
+    uint8_t last = 0;
+
+    for (size_t i = 0; i < block.size(); i += Jit::length(block[i])) {
+        if (pin)
+            builder.CreateCall2(at, gb, ConstantInt::get(Type::getInt16Ty(context), address + i));
+
+        last = block[i];
+        builder.CreateCall(opcodes[last], gb);
+        if (last == 0xcb)
+            builder.CreateCall(opcodes[256 + block[i + 1]], gb);
+
+        auto end = i + Jit::length(last);
+        if (end < block.size() && Jit::may_schedule(&block[i])) {
+            auto resume = BasicBlock::Create(context, "resume", func);
+            vector<uint8_t> rest(block.begin() + static_cast<ptrdiff_t>(end), block.end());
+            check_budget(builder, gb, Jit::cycles(rest), resume, exit);
+            builder.SetInsertPoint(resume);
+        }
+    }
+
+    next = address + static_cast<unsigned>(block.size());
+    return last;
+}
+
+/* A function calling the opcode functions for each instruction of block in
+ * turn, and counting which way its final branch goes if branches is given.
+ * Nothing runs unless the whole block fits before the next event, and it
+ * leaves part way if an instruction brings the next event forward.
+ */
+Function *define_block(Module &mod, const array<Function *, 512> &opcodes,
+        const string &name, uint16_t address, const vector<uint8_t> &block,
+        bool pin, BranchCounts *branches)
+{
+    auto &context = mod.getContext();
+    auto func = Function::Create(block_type(mod), Function::ExternalLinkage, name, &mod);
+
+    auto gb = static_cast<Value *>(func->arg_begin());
+    gb->setName("gb");
+
+    auto entry = BasicBlock::Create(context, "entry", func);
+    auto body = BasicBlock::Create(context, "body", func);
+    auto exit = BasicBlock::Create(context, "exit", func);
+    IRBuilder<>{exit}.CreateRetVoid();
+
+    auto builder = IRBuilder<>{entry};
+    check_budget(builder, gb, Jit::cycles(block), body, exit);
+    builder.SetInsertPoint(body);
+
+    unsigned next;
+    auto last = call_opcodes(builder, opcodes, gb, address, block, pin, exit, next);
+
+    if (branches && Jit::is_conditional(last)) {
+        auto profile = mod.getFunction("jit_profile");
+        auto counts = ConstantInt::get(Type::getInt64Ty(context),
+                reinterpret_cast<uintptr_t>(branches + next));
+        builder.CreateCall3(profile, gb,
+                ConstantInt::get(Type::getInt16Ty(context), next),
+                ConstantExpr::getIntToPtr(counts,
+                    profile->getFunctionType()->getParamType(2)));
+    }
+
+    builder.CreateBr(exit);
+    return func;
+}
+
+/* A function running each block of trace in turn. Before each block it
+ * checks that execution went the way the trace does and that the block fits
+ * before the next event, and otherwise returns to the dispatch loop.
+ * Everything lives in the machine, so there is nothing else to write back
+ * on leaving early.
+ */
+Function *define_trace(Module &mod, const array<Function *, 512> &opcodes,
+        const string &name, const Compiler::block_list &trace, bool loops)
+{
+    auto &context = mod.getContext();
+    auto func = Function::Create(block_type(mod), Function::ExternalLinkage, name, &mod);
+
+    auto gb = static_cast<Value *>(func->arg_begin());
+    gb->setName("gb");
+
+    auto entry = BasicBlock::Create(context, "entry", func);
+    auto head = BasicBlock::Create(context, "head", func);
+    auto exit = BasicBlock::Create(context, "exit", func);
+    IRBuilder<>{exit}.CreateRetVoid();
+
+    auto builder = IRBuilder<>{entry};
+    check_budget(builder, gb, Jit::cycles(trace.front().second), head, exit);
+    builder.SetInsertPoint(head);
+
+    auto carry_on = mod.getFunction("jit_continue");
+    for (size_t i = 0; i < trace.size(); ++i) {
+        unsigned next;
+        call_opcodes(builder, opcodes, gb, trace[i].first, trace[i].second, true, exit, next);
+
+        auto last = i + 1 == trace.size();
+        if (last && !loops)
+            break;
+
+        const auto &target = last ? trace.front() : trace[i + 1];
+        auto result = builder.CreateCall3(carry_on, gb,
+                ConstantInt::get(Type::getInt16Ty(context), target.first),
+                ConstantInt::get(Type::getInt32Ty(context), Jit::cycles(target.second)));
+        auto taken = builder.CreateICmpNE(result, ConstantInt::get(result->getType(), 0));
+
+        auto segment = last ? head : BasicBlock::Create(context, "segment", func);
+        builder.CreateCondBr(taken, segment, exit);
+        builder.SetInsertPoint(segment);
     }
 
-    uintptr_t compile(uint16_t address, const std::vector<uint8_t> &block)
+    if (!loops)
+        builder.CreateBr(exit);
+    return func;
+}
+
+/* The native target is the only LLVM state shared between compilers, set up
+ * on the first one used. Everything else, down to the context, belongs to a
+ * single compiler, so compilers on different threads never contend.
+ */
+void initialize_target()
+{
+    static once_flag once;
+    call_once(once, [] {
+        InitializeNativeTarget();
+        InitializeNativeTargetAsmPrinter();
+    });
+}
+
+/* Passes each function the JIT emits on to GDB, and to the process's perf
+ * map if any, under the name given for it or otherwise its own. GDB forgets
+ * them along with the listener, which goes with the engine and its code.
+ */
+class Listener : public JITEventListener {
+public:
+    void name(const Function *func, string name)
     {
-        auto name = "jit_" + to_string(address);
-        auto func = Function::Create(opcode_type_, Function::ExternalLinkage, name, mod_);
+        names_[func] = move(name);
+    }
 
-        auto gb = static_cast<Value *>(func->arg_begin());
-        gb->setName("gb");
+    void NotifyFunctionEmitted(const Function &func, void *code, size_t size,
+            const EmittedFunctionDetails &) override
+    {
+        auto address = reinterpret_cast<uintptr_t>(code);
+        auto name = names_.find(&func);
+        auto described = name == names_.end() ? func.getName().str() : move(name->second);
+        if (name != names_.end())
+            names_.erase(name);
 
-        auto entry = BasicBlock::Create(context_, "entry", func);
-        auto builder = IRBuilder<>{entry};
+        if (auto perf = PerfMap::get())
+            perf->add(address, size, described);
+        gdb_.emplace_back(new GdbEntry{address, size, described});
+    }
 
-        auto is_cb = false;
-        for (const auto &op : block) {
-            builder.CreateCall(opcodes_[op + (is_cb ? 256 : 0)], gb);
-            is_cb = op == 0xcb;
+private:
+    map<const Function *, string> names_;
+    vector<unique_ptr<GdbEntry>> gdb_;
+};
+
+/* Module and engine for one tier. Baseline blocks are left as calls to the
+ * opcode functions and go through the fast instruction selector, optimized
+ * blocks have the opcodes inlined and optimized together, with their
+ * immediates folded in.
+ */
+class Engine {
+public:
+    Engine(const Module &opcodes, Compiler::Tier tier)
+      : optimize_(tier == Compiler::Tier::OPTIMIZED),
+        opcodes_(),
+        pm_(),
+        mod_(CloneModule(&opcodes)),
+        cleanup_(mod_),
+        immediate_(mod_->getFunction("jit_immediate")),
+        listener_(),
+        ee_(EngineBuilder(mod_)
+                .setOptLevel(optimize_ ? CodeGenOpt::Aggressive : CodeGenOpt::None)
+                .create())
+    {
+        opcodes_ = opcode_functions(*mod_);
+        ee_->RegisterJITEventListener(&listener_);
+        if (optimize_) {
+            add_passes(pm_);
+            add_cleanup_passes(cleanup_);
+            cleanup_.doInitialization();
         }
+    }
 
-        builder.CreateRetVoid();
+    uintptr_t compile(uint16_t address, const std::vector<uint8_t> &block,
+            BranchCounts *branches)
+    {
+        auto func = define_block(*mod_, opcodes_, "jit_" + to_string(address),
+                address, block, optimize_, branches);
+        listener_.name(func, (optimize_ ? "gb.optimized " : "gb.baseline ") +
+                describe(address, block));
+        return finish(func, {{address, block}});
+    }
 
-        pm_.run(*mod_);
+    uintptr_t compile_trace(const Compiler::block_list &trace, bool loops)
+    {
+        auto func = define_trace(*mod_, opcodes_,
+                "trace_" + to_string(trace.front().first), trace, loops);
+        string name = loops ? "gb.loop" : "gb.trace";
+        for (const auto &segment : trace)
+            name += " | " + describe(segment.first, segment.second);
+        listener_.name(func, move(name));
+        return finish(func, trace);
+    }
 
+private:
+    uintptr_t finish(Function *func, const Compiler::block_list &blocks)
+    {
+        if (optimize_) {
+            pm_.run(*mod_);
+            if (fold_immediates(*func, immediate_, blocks))
+                cleanup_.run(*func);
+        }
         return reinterpret_cast<uintptr_t>(ee_->getPointerToFunction(func));
     }
 
-private:
+    bool optimize_;
     std::array<Function *, 512> opcodes_;
 
-    LLVMContext context_;
     PassManager pm_;
     Module *mod_;
-    ExecutionEngine *ee_;
-    Type *gb_type_;
-    Type *gb_type_ptr_;
-    FunctionType *opcode_type_;
+    legacy::FunctionPassManager cleanup_;
+    Function *immediate_;
+    Listener listener_;
+    unique_ptr<ExecutionEngine> ee_;
 };
 
+}
+
+/* A context and parsed opcodes of its own, which each tier's engine clones
+ * its module from on its first compile. Declared so that the engines go
+ * before the module, and the module before the context.
+ */
+class Compiler::impl {
+public:
+    impl()
+      : context_(),
+        opcodes_(),
+        engines_()
+    {
+        initialize_target();
+        opcodes_.reset(parse_opcodes(context_));
+    }
+
+    Engine &engine(Tier tier)
+    {
+        auto &engine = engines_[static_cast<size_t>(tier)];
+        if (!engine)
+            engine.reset(new Engine{*opcodes_, tier});
+        return *engine;
+    }
+
+private:
+    LLVMContext context_;
+    unique_ptr<Module> opcodes_;
+    array<unique_ptr<Engine>, 2> engines_;
+};
+
+/* Nothing is set up until the first compile, so machines which never use the
+ * JIT don't pay for it
+ */
 Compiler::Compiler()
-  : pimpl_(new Compiler::impl)
+  : pimpl_()
 { }
 
-Compiler::~Compiler()
-{ }
+Compiler::~Compiler() = default;
 
-uintptr_t Compiler::compile(uint16_t address, const std::vector<uint8_t> &block)
+uintptr_t Compiler::compile(uint16_t address, const std::vector<uint8_t> &block, Tier tier,
+        BranchCounts *branches)
 {
-    return pimpl_->compile(address, block);
+    if (!pimpl_)
+        pimpl_.reset(new impl);
+    return pimpl_->engine(tier).compile(address, block, branches);
+}
+
+uintptr_t Compiler::compile_trace(const block_list &trace, bool loops)
+{
+    if (!pimpl_)
+        pimpl_.reset(new impl);
+    return pimpl_->engine(Tier::OPTIMIZED).compile_trace(trace, loops);
+}
+
+/* Bumped whenever the code generated around the opcodes changes, so that
+ * modules built by an older compiler are rejected like those of older opcodes
+ */
+constexpr uint64_t codegen_revision = 2;
+
+uint64_t Compiler::version()
+{
+    static const uint64_t version = [] {
+        uint64_t hash = 0xcbf29ce484222325 ^ codegen_revision;
+        for (auto byte = _binary_opcodes_bc_start; byte != _binary_opcodes_bc_end; ++byte) {
+            hash ^= static_cast<uint8_t>(*byte);
+            hash *= 0x100000001b3;
+        }
+        return hash;
+    }();
+    return version;
+}
+
+/* The module exports the table, in the layout of PrecompiledModule and
+ * PrecompiledBlock, and the blocks, named as the JIT names its code for
+ * profilers and debuggers, which read them from the module's symbols. The
+ * opcodes are internal to it. Built in a context of its own, like a
+ * compiler's.
+ */
+bool Compiler::emit(const std::string &path, uint64_t rom_hash, const block_list &blocks)
+{
+    initialize_target();
+
+    LLVMContext context;
+    unique_ptr<Module> mod{parse_opcodes(context)};
+
+    for (auto &func : *mod)
+        if (!func.isDeclaration())
+            func.setLinkage(GlobalValue::InternalLinkage);
+    for (auto global = mod->global_begin(); global != mod->global_end(); ++global)
+        if (!global->isDeclaration())
+            global->setLinkage(GlobalValue::InternalLinkage);
+
+    auto opcodes = opcode_functions(*mod);
+    auto immediate = mod->getFunction("jit_immediate");
+    auto i8 = Type::getInt8Ty(context);
+    auto i16 = Type::getInt16Ty(context);
+    auto i64 = Type::getInt64Ty(context);
+    auto i8_ptr = Type::getInt8PtrTy(context);
+
+    auto entry_type = StructType::get(context, { i8_ptr, i8_ptr, i16, i8 }, false);
+    vector<Constant *> entries;
+    vector<Function *> funcs;
+    for (const auto &block : blocks) {
+        auto func = define_block(*mod, opcodes, "gb.precompiled " +
+                describe(block.first, block.second), block.first, block.second, true, nullptr);
+        func->setVisibility(GlobalValue::ProtectedVisibility);
+        funcs.push_back(func);
+
+        auto data = ConstantDataArray::get(context, ArrayRef<uint8_t>{block.second});
+        auto opcodes_global = new GlobalVariable(*mod, data->getType(), true,
+                GlobalValue::PrivateLinkage, data);
+
+        entries.push_back(ConstantStruct::get(entry_type, {
+            ConstantExpr::getBitCast(func, i8_ptr),
+            ConstantExpr::getBitCast(opcodes_global, i8_ptr),
+            ConstantInt::get(i16, block.first),
+            ConstantInt::get(i8, block.second.size()),
+        }));
+    }
+
+    auto array_type = ArrayType::get(entry_type, entries.size());
+    auto array = new GlobalVariable(*mod, array_type, true, GlobalValue::PrivateLinkage,
+            ConstantArray::get(array_type, entries));
+
+    auto entry_ptr = PointerType::getUnqual(entry_type);
+    auto table_type = StructType::get(context, { i64, i64, i64, entry_ptr }, false);
+    new GlobalVariable(*mod, table_type, true, GlobalValue::ExternalLinkage,
+            ConstantStruct::get(table_type, {
+                ConstantInt::get(i64, version()),
+                ConstantInt::get(i64, rom_hash),
+                ConstantInt::get(i64, entries.size()),
+                ConstantExpr::getBitCast(array, entry_ptr),
+            }), precompiled_symbol);
+
+    /* Modules may be shipped to other machines, so target the generic CPU
+     * rather than this one
+     */
+    auto triple = sys::getDefaultTargetTriple();
+    string error;
+    auto target = TargetRegistry::lookupTarget(triple, error);
+    if (!target)
+        return false;
+    unique_ptr<TargetMachine> machine{target->createTargetMachine(triple, "", "",
+            TargetOptions{}, Reloc::PIC_, CodeModel::Default, CodeGenOpt::Aggressive)};
+    if (!machine)
+        return false;
+
+    mod->setTargetTriple(triple);
+    if (auto layout = machine->getDataLayout())
+        mod->setDataLayout(layout);
+
+    raw_fd_ostream out{path.c_str(), error, sys::fs::F_None};
+    if (!error.empty())
+        return false;
+    formatted_raw_ostream formatted{out};
+
+    PassManager optimize;
+    optimize.add(new DataLayoutPass(mod.get()));
+    add_passes(optimize);
+    optimize.run(*mod);
+    for (size_t i = 0; i < funcs.size(); ++i)
+        fold_immediates(*funcs[i], immediate, {blocks[i]});
+
+    PassManager pm;
+    pm.add(new DataLayoutPass(mod.get()));
+    add_cleanup_passes(pm);
+    if (machine->addPassesToEmitFile(pm, formatted, TargetMachine::CGFT_ObjectFile))
+        return false;
+    pm.run(*mod);
+
+    return true;
 }
 
 }
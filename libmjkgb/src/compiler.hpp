@@ -1,17 +1,80 @@
 #ifndef COMPILER_HPP_
 #define COMPILER_HPP_
 
+#include <atomic>
+#include <cstdint>
 #include <memory>
+#include <string>
+#include <utility>
 #include <vector>
 
 namespace mjkgb {
 
+/* Layout of the table exported by modules compiled ahead of time */
+struct PrecompiledBlock {
+    const void *native;
+    const uint8_t *opcodes;
+    uint16_t address;
+    uint8_t size;
+};
+
+struct PrecompiledModule {
+    uint64_t version;
+    uint64_t rom_hash;
+    uint64_t count;
+    const PrecompiledBlock *blocks;
+};
+
+constexpr char precompiled_symbol[] = "mjkgb_precompiled";
+
+/* How often a conditional branch went each way, counted by baseline code */
+struct BranchCounts {
+    std::atomic<uint32_t> not_taken;
+    std::atomic<uint32_t> taken;
+};
+
+/* Compiles blocks into code which lives as long as the compiler. A compiler
+ * is used by one thread at a time, but each has its own LLVM context, so
+ * separate compilers can run on separate threads.
+ */
 class Compiler {
 public:
+    /* Blocks of instructions, as decoded by Jit::decode, by address */
+    using block_list = std::vector<std::pair<uint16_t, std::vector<uint8_t>>>;
+
     Compiler();
     ~Compiler();
 
-    uintptr_t compile(uint16_t address, const std::vector<uint8_t> &block);
+    /* Baseline code is quick to generate, for blocks which have only just
+     * become warm. Optimized code takes longer, for those which stay hot.
+     */
+    enum class Tier {
+        BASELINE,
+        OPTIMIZED,
+    };
+
+    /* Baseline code counts how its final branch goes into branches, if
+     * given, indexed by the address following the branch
+     */
+    uintptr_t compile(uint16_t address, const std::vector<uint8_t> &block, Tier tier,
+            BranchCounts *branches = nullptr);
+
+    /* Optimized code running each block of trace in turn, as long as
+     * execution continues to the next, and looping back to the first from
+     * the last if loops is set
+     */
+    uintptr_t compile_trace(const block_list &trace, bool loops);
+
+    /* Hash of the opcode bitcode and the revision of the code generated
+     * around it, which changes whenever what any compiled block would do
+     * might have
+     */
+    static uint64_t version();
+
+    /* Write an object file of the given blocks of a ROM compiled ahead of
+     * time, to be linked into a shared module for CodeCache::load_module
+     */
+    static bool emit(const std::string &path, uint64_t rom_hash, const block_list &blocks);
 
 private:
     class impl;
@@ -3,14 +3,17 @@
 
 #include <array>
 #include <cstdint>
-
-// Temp
-#include <iostream>
+#include <cstring>
 
 #include "operands.hpp"
+#include "state.hpp"
 
 namespace mjkgb {
 
+enum class Interrupt {
+    VBLANK, LCD_STAT, TIMER, SERIAL, JOYPAD
+};
+
 class Cpu {
 public:
     Cpu()
@@ -55,8 +58,12 @@ public:
     inline void tick()
     {
         clock_++;
-        if (clock_ % 240 == 0)
-            std::cout << "VSYNC!" << std::endl;
+    }
+
+    /* Advance the clock without doing any work, for skipping idle time */
+    inline void skip(unsigned long cycles)
+    {
+        clock_ += cycles;
     }
 
     inline unsigned long get_clock() const
@@ -94,6 +101,22 @@ public:
         return interrupt_flag_;
     }
 
+    inline void save_state(StateWriter &state) const
+    {
+        state.put(stopped_);
+        state.put(interrupt_flag_);
+        state.put<uint64_t>(clock_);
+        state.put(registers_.data(), registers_.size());
+    }
+
+    inline void load_state(StateReader &state)
+    {
+        state.get(stopped_);
+        state.get(interrupt_flag_);
+        clock_ = static_cast<unsigned long>(state.get<uint64_t>());
+        memcpy(registers_.data(), state.bytes(registers_.size()), registers_.size());
+    }
+
 private:
     static constexpr int num_registers =
         2 * (static_cast<size_t>(WordRegister::SP) + 1);
@@ -0,0 +1,89 @@
+#include "dma.hpp"
+#include "gameboy_impl.hpp"
+#include "mmu.hpp"
+#include "scheduler.hpp"
+#include "state.hpp"
+
+namespace mjkgb {
+
+using namespace std;
+
+constexpr uint16_t Dma::dma_address;
+constexpr uint16_t Dma::oam_address;
+constexpr uint16_t Dma::oam_size;
+constexpr unsigned long Dma::transfer_cycles;
+
+namespace {
+
+uint8_t read_dma(GameboyImpl &gb, uint16_t)
+{
+    return gb.dma_.source();
+}
+
+void write_dma(GameboyImpl &gb, uint16_t, uint8_t value)
+{
+    gb.dma_.start(gb, value);
+}
+
+unsigned long dma_stable_until(GameboyImpl &, uint16_t, unsigned long)
+{
+    return Scheduler::never;
+}
+
+void dma_end(GameboyImpl &gb)
+{
+    gb.dma_.finish(gb);
+}
+
+}
+
+void Dma::start(GameboyImpl &gb, uint8_t source)
+{
+    source_ = source;
+    active_ = true;
+
+    /* Sources past WRAM read from its echo */
+    auto address = static_cast<uint16_t>((source >= 0xe0 ? source - 0x20 : source) << 8);
+    gb.mmu_.copy(oam_address, address, oam_size);
+
+    gb.mmu_.unmap_all();
+    gb.scheduler_.schedule(Event::DMA_END, gb.cpu_.get_clock() + transfer_cycles);
+}
+
+void Dma::finish(GameboyImpl &gb)
+{
+    active_ = false;
+    gb.mmu_.map_all();
+}
+
+void Dma::reset(Mmu &mmu)
+{
+    source_ = 0;
+    active_ = false;
+    mmu.map_all();
+}
+
+void Dma::save_state(StateWriter &state) const
+{
+    state.put(source_);
+    state.put(active_);
+}
+
+void Dma::load_state(StateReader &state, Mmu &mmu)
+{
+    state.get(source_);
+    state.get(active_);
+
+    if (active_)
+        mmu.unmap_all();
+    else
+        mmu.map_all();
+}
+
+void Dma::attach(Mmu &mmu, Scheduler &scheduler)
+{
+    mmu.set_io_handler(dma_address, { read_dma, write_dma, dma_stable_until });
+    scheduler.set_handler(Event::DMA_END, dma_end);
+}
+
+}
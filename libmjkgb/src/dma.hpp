@@ -0,0 +1,60 @@
+#ifndef DMA_HPP_
+#define DMA_HPP_
+
+#include <cstdint>
+
+namespace mjkgb {
+
+struct GameboyImpl;
+class Mmu;
+class Scheduler;
+class StateReader;
+class StateWriter;
+
+/* OAM DMA. The whole transfer is done as a single copy when 0xff46 is
+ * written. For the duration of the transfer the Mmu page table is cleared so
+ * that only HRAM and the I/O registers are accessible, and an event restores
+ * it once the transfer would have finished.
+ */
+class Dma {
+public:
+    static constexpr uint16_t dma_address = 0xff46;
+    static constexpr uint16_t oam_address = 0xfe00;
+    static constexpr uint16_t oam_size = 0xa0;
+
+    /* One byte is transferred per cycle */
+    static constexpr unsigned long transfer_cycles = oam_size;
+
+    Dma()
+      : source_(0),
+        active_(false)
+    { }
+
+    inline uint8_t source() const
+    {
+        return source_;
+    }
+
+    inline bool active() const
+    {
+        return active_;
+    }
+
+    void start(GameboyImpl &gb, uint8_t source);
+    void finish(GameboyImpl &gb);
+
+    void reset(Mmu &mmu);
+
+    void save_state(StateWriter &state) const;
+    void load_state(StateReader &state, Mmu &mmu);
+
+    void attach(Mmu &mmu, Scheduler &scheduler);
+
+private:
+    uint8_t source_;
+    bool active_;
+};
+
+}
+
+#endif /* DMA_HPP_ */
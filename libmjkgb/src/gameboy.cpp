@@ -1,9 +1,14 @@
+#include <algorithm>
 #include <cstdint>
 #include <fstream>
 #include <istream>
+#include <memory>
+#include <utility>
+#include <vector>
 
 #include "mjkgb.hpp"
 #include "gameboy_impl.hpp"
+#include "perf_map.hpp"
 
 namespace mjkgb {
 
@@ -19,9 +24,19 @@ Gameboy::Gameboy(const string &filename)
     load(filename);
 }
 
+Gameboy::Gameboy(unique_ptr<impl> pimpl)
+  : pimpl_(move(pimpl))
+{ }
+
 Gameboy::~Gameboy()
 { }
 
+unique_ptr<Gameboy> Gameboy::clone() const
+{
+    unique_ptr<impl> copy{new Gameboy::impl(*pimpl_)};
+    return unique_ptr<Gameboy>{new Gameboy(move(copy))};
+}
+
 void Gameboy::load(const string &filename)
 {
     ifstream is{filename, ifstream::binary};
@@ -34,10 +49,218 @@ void Gameboy::load(istream &is)
     pimpl_->load(is);
 }
 
+void Gameboy::setButtons(uint8_t buttons)
+{
+    pimpl_->joypad_.set_buttons(*pimpl_, buttons);
+}
+
+void Gameboy::queueButtons(unsigned long cycles, uint8_t buttons)
+{
+    pimpl_->joypad_.queue(*pimpl_, pimpl_->cpu_.get_clock() + cycles, buttons);
+}
+
+void Gameboy::queueButtonsAtFrame(unsigned long frames, uint8_t buttons)
+{
+    auto clock = pimpl_->cpu_.get_clock();
+    if (frames)
+        clock = pimpl_->lcd_.next_vblank(clock) + (frames - 1) * Lcd::cycles_per_frame;
+    pimpl_->joypad_.queue(*pimpl_, clock, buttons);
+}
+
+void Gameboy::clearQueuedButtons()
+{
+    pimpl_->joypad_.clear_queue(*pimpl_);
+}
+
+size_t Gameboy::readAudio(int16_t *buffer, size_t frames)
+{
+    return pimpl_->apu_.read_samples(buffer, 2 * frames) / 2;
+}
+
+void Gameboy::setAudioRate(int rate)
+{
+    pimpl_->apu_.set_sample_rate(static_cast<unsigned>(max(rate, 0)));
+}
+
+void Gameboy::setAudioEnabled(bool enabled)
+{
+    pimpl_->apu_.set_synthesis(enabled);
+}
+
+void Gameboy::setVsyncCallback(vsync_cb callback)
+{
+    pimpl_->vsync_ = move(callback);
+    if (pimpl_->vsync_ && !pimpl_->frame_) {
+        pimpl_->frame_.reset(new frame);
+        pimpl_->frame_->fill(0xff);
+    }
+}
+
 void Gameboy::run()
 {
     pimpl_->run();
 }
 
+void Gameboy::runCycles(unsigned long cycles)
+{
+    pimpl_->run_until(pimpl_->cpu_.get_clock() + cycles);
+}
+
+void Gameboy::runFrame()
+{
+    pimpl_->run_frame();
+}
+
+size_t Gameboy::stateSize() const
+{
+    return pimpl_->state_size();
+}
+
+size_t Gameboy::saveState(uint8_t *buffer, size_t size)
+{
+    return pimpl_->save_snapshot(buffer, size, false);
+}
+
+vector<uint8_t> Gameboy::saveState()
+{
+    vector<uint8_t> buffer(stateSize());
+    saveState(buffer.data(), buffer.size());
+    return buffer;
+}
+
+size_t Gameboy::saveDelta(uint8_t *buffer, size_t size)
+{
+    return pimpl_->save_snapshot(buffer, size, true);
+}
+
+vector<uint8_t> Gameboy::saveDelta()
+{
+    vector<uint8_t> buffer(stateSize());
+    buffer.resize(saveDelta(buffer.data(), buffer.size()));
+    return buffer;
+}
+
+bool Gameboy::loadState(const uint8_t *data, size_t size)
+{
+    StateReader state{data, size};
+    return pimpl_->load_state(state);
+}
+
+bool Gameboy::loadState(const vector<uint8_t> &state)
+{
+    return loadState(state.data(), state.size());
+}
+
+uint64_t Gameboy::stateHash() const
+{
+    return pimpl_->state_hash();
+}
+
+void Gameboy::setRewindBudget(size_t bytes)
+{
+    auto &rewind = pimpl_->rewind_;
+    if (!bytes)
+        rewind.reset();
+    else if (!rewind)
+        rewind.reset(new Rewind{bytes});
+    else
+        rewind->set_budget(bytes);
+}
+
+size_t Gameboy::rewindFrames() const
+{
+    return pimpl_->rewind_ ? pimpl_->rewind_->frames() : 0;
+}
+
+bool Gameboy::rewind(size_t frames)
+{
+    return pimpl_->rewind_ && pimpl_->rewind_->rewind(*pimpl_, frames);
+}
+
+unsigned long Gameboy::idleCyclesSkipped() const
+{
+    return pimpl_->idle_.skipped();
+}
+
+unsigned long Gameboy::cycles() const
+{
+    return pimpl_->cpu_.get_clock();
+}
+
+bool Gameboy::startProfiling(unsigned long period)
+{
+#ifdef MJKGB_PROFILER
+    if (!period)
+        return false;
+
+    pimpl_->profiler_.start(period, pimpl_->cpu_.get_clock());
+    pimpl_->schedule_sample();
+    return true;
+#else
+    return false;
+#endif
+}
+
+void Gameboy::stopProfiling()
+{
+#ifdef MJKGB_PROFILER
+    pimpl_->profiler_.stop();
+    pimpl_->schedule_sample();
+#endif
+}
+
+std::string Gameboy::profile() const
+{
+#ifdef MJKGB_PROFILER
+    return pimpl_->profiler_.collapsed();
+#else
+    return {};
+#endif
+}
+
+void Gameboy::setJitThreshold(unsigned jumps)
+{
+    pimpl_->jit_.set_threshold(jumps);
+}
+
+size_t Gameboy::compiledBlocks() const
+{
+    return pimpl_->jit_.compiled();
 }
 
+void Gameboy::setJitOptimizeThreshold(unsigned entries)
+{
+    pimpl_->jit_.set_optimize_threshold(entries);
+}
+
+size_t Gameboy::optimizedBlocks() const
+{
+    return pimpl_->jit_.optimized();
+}
+
+void Gameboy::setJitCacheDirectory(const std::string &directory)
+{
+    CodeCache::set_directory(directory);
+}
+
+bool Gameboy::loadPrecompiled(const std::string &path)
+{
+    return CodeCache::load_module(path);
+}
+
+void Gameboy::enableJitPerfMap(const std::string &dump_directory)
+{
+    PerfMap::enable(dump_directory);
+}
+
+void GameboyImpl::vblank()
+{
+    request_interrupt(Interrupt::VBLANK);
+
+    if (vsync_)
+        vsync_(*frame_);
+    if (rewind_)
+        rewind_->capture(*this);
+}
+
+}
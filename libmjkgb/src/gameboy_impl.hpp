@@ -3,29 +3,129 @@
 
 #include <cstdint>
 #include <iosfwd>
+#include <memory>
 #include <string>
 
 #include "mjkgb.hpp"
-#include "compiler.hpp"
+#include "apu.hpp"
+#include "code_cache.hpp"
 #include "cpu.hpp"
+#include "dma.hpp"
+#include "idle_loop.hpp"
+#include "jit.hpp"
+#include "joypad.hpp"
+#include "lcd.hpp"
 #include "mmu.hpp"
 #include "operands.hpp"
+#include "profiler.hpp"
+#include "rewind.hpp"
+#include "scheduler.hpp"
+#include "state.hpp"
+#include "timer.hpp"
 
 namespace mjkgb {
 
 template<typename T> struct accessor;
 
+#ifdef EMIT_LLVM
+struct GameboyImpl;
+
+/* Compiled code reads immediate operands through this rather than the MMU,
+ * so that the compiler can replace the reads with the bytes it compiled
+ */
+extern "C" uint8_t jit_immediate(GameboyImpl &gb, uint16_t address) __attribute__((pure));
+#endif
+
 /* Need to be able to pass GameboyImpl ref to accessor funcs, so can't directly
  * implement Gameboy::impl due to it being private. Also don't want to make
  * Gameboy::impl public. Use inheritance to work around this issue.
  */
 struct GameboyImpl {
+    static constexpr uint16_t interrupt_flag_address = 0xff0f;
+    static constexpr uint16_t interrupt_enable_address = 0xffff;
+
     GameboyImpl()
       : cpu_(),
-        mmu_(),
-        compiler_()
+        mmu_(*this),
+        scheduler_(),
+        lcd_(),
+        timer_(),
+        dma_(),
+        joypad_(),
+        apu_(),
+        idle_(),
+        code_(),
+        jit_(),
+        rewind_(),
+#ifdef MJKGB_PROFILER
+        profiler_(),
+#endif
+        vsync_(),
+        frame_(),
+        generation_(0),
+        yield_(false),
+        in_native_(false),
+        chained_(0)
+    {
+        auto write_interrupts = [](GameboyImpl &gb, uint16_t address, uint8_t value) {
+            gb.mmu_.poke(address, value);
+            gb.check_interrupts();
+        };
+        mmu_.set_io_handler(interrupt_flag_address, { nullptr, write_interrupts, nullptr });
+        mmu_.set_io_handler(interrupt_enable_address, { nullptr, write_interrupts, nullptr });
+        scheduler_.set_handler(Event::INTERRUPT, [](GameboyImpl &gb) {
+            gb.service_interrupts();
+        });
+        scheduler_.set_handler(Event::RUN_END, [](GameboyImpl &gb) {
+            gb.yield_ = true;
+        });
+#ifdef MJKGB_PROFILER
+        scheduler_.set_handler(Event::PROFILE_SAMPLE, [](GameboyImpl &gb) {
+            if (gb.profiler_.period())
+                gb.profiler_.sample(gb.cpu_.get(WordRegister::PC));
+            gb.schedule_sample();
+        });
+#endif
+
+        lcd_.attach(mmu_, scheduler_);
+        timer_.attach(mmu_, scheduler_);
+        dma_.attach(mmu_, scheduler_);
+        joypad_.attach(mmu_, scheduler_);
+        apu_.attach(mmu_, scheduler_);
+        lcd_.reset(*this);
+        apu_.reset(*this);
+    }
+
+    /* Copies all guest state, the compiler and compiled code are shared.
+     * Rewind history, profiling and the vsync callback stay with the
+     * original.
+     */
+    GameboyImpl(const GameboyImpl &other)
+      : cpu_(other.cpu_),
+        mmu_(*this, other.mmu_),
+        scheduler_(other.scheduler_),
+        lcd_(other.lcd_),
+        timer_(other.timer_),
+        dma_(other.dma_),
+        joypad_(other.joypad_),
+        apu_(other.apu_),
+        idle_(other.idle_),
+        code_(other.code_),
+        jit_(other.jit_),
+        rewind_(),
+#ifdef MJKGB_PROFILER
+        profiler_(),
+#endif
+        vsync_(),
+        frame_(),
+        generation_(other.generation_),
+        yield_(false),
+        in_native_(false),
+        chained_(0)
     { }
 
+    GameboyImpl &operator=(const GameboyImpl &) = delete;
+
     template<typename T>
     typename accessor<T>::value_type get(T operand)
     {
@@ -43,24 +143,191 @@ struct GameboyImpl {
         cpu_.tick();
     }
 
+    /* Read an operand following an opcode */
+    inline uint8_t immediate(uint16_t address)
+    {
+#ifdef EMIT_LLVM
+        return jit_immediate(*this, address);
+#else
+        return mmu_.get(address);
+#endif
+    }
+
+    /* What reading an opcode costs, for compiled code which already knows
+     * which opcode it is
+     */
+    inline void fetch()
+    {
+        cpu_.set(WordRegister::PC, cpu_.get(WordRegister::PC) + 1);
+        tick();
+    }
+
     inline void load(std::istream &is)
     {
         mmu_.load(is);
+        generation_ = 0;
+        attach_code();
+    }
+
+    /* Switch to the compiled code of the ROM now in memory, leaving the old
+     * ROM's cache to the machines still running it
+     */
+    inline void attach_code()
+    {
+        jit_.clear();
+        code_ = CodeCache::get(CodeCache::hash(mmu_));
+        code_->install(mmu_);
+    }
+
+    inline void reset()
+    {
+        cpu_.reset();
+        scheduler_.reset();
+        lcd_.reset(*this);
+        timer_.reset();
+        dma_.reset(mmu_);
+        joypad_.reset();
+        apu_.reset(*this);
+        idle_.reset();
+#ifdef MJKGB_PROFILER
+        profiler_.restart(cpu_.get_clock());
+        schedule_sample();
+#endif
+    }
+
+    inline void request_interrupt(Interrupt interrupt)
+    {
+        auto flags = mmu_.peek(interrupt_flag_address);
+        mmu_.poke(interrupt_flag_address, flags | 1 << static_cast<int>(interrupt));
+        check_interrupts();
     }
 
+    /* Interrupts are dispatched at the next instruction boundary after delay
+     * cycles have passed.
+     */
+    inline void check_interrupts(unsigned long delay = 0)
+    {
+        scheduler_.schedule(Event::INTERRUPT, cpu_.get_clock() + delay);
+    }
+
+    void service_interrupts();
+
+    /* Called at the start of every VBlank */
+    void vblank();
+
+#ifdef MJKGB_PROFILER
+    /* Take the next profiling sample when it's due, if profiling */
+    inline void schedule_sample()
+    {
+        if (profiler_.period())
+            scheduler_.schedule(Event::PROFILE_SAMPLE, profiler_.due());
+        else
+            scheduler_.cancel(Event::PROFILE_SAMPLE);
+    }
+#endif
+
+    /* Save states, see state.cpp for the format */
+    size_t state_size() const;
+    void save_state(StateWriter &state, const Mmu::page_set &pages,
+            uint64_t generation = 0, uint64_t parent = 0) const;
+    bool load_state(StateReader &state);
+
+    /* Save a full state, or a delta on top of the state last saved or loaded,
+     * and make it the parent of the next delta. Without a parent to build
+     * on, a delta holds every page. Returns the size, or 0 if the buffer is
+     * too small.
+     */
+    size_t save_snapshot(uint8_t *buffer, size_t size, bool delta);
+
+    /* Hash of the state, equal for machines in the same state however they
+     * got there
+     */
+    uint64_t state_hash() const;
+
+    void save_machine(StateWriter &state) const;
+    void load_machine(StateReader &state);
+
     inline void jump(uint16_t address, bool tick = true)
     {
-        auto native = reinterpret_cast<void(*)(GameboyImpl &)>(mmu_.get_native(address));
+        auto native = mmu_.get_native(address);
+        auto from = cpu_.get(WordRegister::PC);
         cpu_.set(WordRegister::PC, address, tick);
-        if (native)
-            native(*this);
+        if (address < from)
+            cpu_.skip(idle_.branch(mmu_, address, from, cpu_.get_clock(), scheduler_.next()));
+
+        auto hook = jit_.get_hook();
+        if (hook)
+            native = hook(*this, address, native);
+
+        /* Compiled code checks on entry that it can run without passing the
+         * next event, and again after anything which can schedule one, and
+         * otherwise leaves it to the dispatch loop
+         */
+        if (!native)
+            return;
+
+        /* A block ends with its only jump, so rather than nesting a call for
+         * every block entered, compiled code hands the next block back to the
+         * outermost jump
+         */
+        if (in_native_) {
+            chained_ = native;
+            return;
+        }
+
+        in_native_ = true;
+        while (native) {
+            chained_ = 0;
+            reinterpret_cast<void (*)(GameboyImpl &)>(native)(*this);
+            native = chained_;
+        }
+        in_native_ = false;
     }
 
+    /* Run from power on until STOP */
     void run();
 
+    /* Run without resetting until the first instruction boundary at or after
+     * clock, or STOP
+     */
+    void run_until(unsigned long clock);
+
+    inline void run_frame()
+    {
+        run_until(lcd_.next_vblank(cpu_.get_clock()));
+    }
+
     Cpu cpu_;
     Mmu mmu_;
-    Compiler compiler_;
+    Scheduler scheduler_;
+    Lcd lcd_;
+    Timer timer_;
+    Dma dma_;
+    Joypad joypad_;
+    Apu apu_;
+    IdleLoop idle_;
+    std::shared_ptr<CodeCache> code_;
+    Jit jit_;
+    std::unique_ptr<Rewind> rewind_;
+#ifdef MJKGB_PROFILER
+    Profiler profiler_;
+#endif
+
+    /* The frame is only allocated once a callback is set */
+    Gameboy::vsync_cb vsync_;
+    std::unique_ptr<Gameboy::frame> frame_;
+
+    /* Generation of the state whose memory the dirty pages are relative to,
+     * 0 if there is none to save a delta against
+     */
+    uint64_t generation_;
+
+    /* Set by the RUN_END event to return from run_until */
+    bool yield_;
+
+    /* Set while compiled code is running, and the block it jumped to */
+    bool in_native_;
+    uintptr_t chained_;
 
     template<typename T> friend struct accessor;
 };
@@ -259,8 +526,8 @@ struct accessor<ByteImmediate> {
 
     value_type get(GameboyImpl &gb, ByteImmediate) const
     {
-        auto imm_ptr = byte_ptr(WordRegister::PC);
-        auto ret = accessor<decltype(imm_ptr)>().get(gb, imm_ptr);
+        auto ret = gb.immediate(gb.cpu_.get(WordRegister::PC));
+        gb.tick();
         gb.cpu_.set(WordRegister::PC, gb.cpu_.get(WordRegister::PC) + sizeof(value_type));
         return ret;
     }
@@ -274,8 +541,11 @@ struct accessor<WordImmediate> {
 
     value_type get(GameboyImpl &gb, WordImmediate) const
     {
-        auto imm_ptr = word_ptr(WordRegister::PC);
-        auto ret = accessor<decltype(imm_ptr)>().get(gb, imm_ptr);
+        auto address = gb.cpu_.get(WordRegister::PC);
+        auto ret = value_type{gb.immediate(address)};
+        gb.tick();
+        ret |= gb.immediate(static_cast<uint16_t>(address + 1)) << 8;
+        gb.tick();
         gb.cpu_.set(WordRegister::PC, gb.cpu_.get(WordRegister::PC) + sizeof(value_type));
         return ret;
     }
@@ -0,0 +1,169 @@
+#ifndef IDLE_LOOP_HPP_
+#define IDLE_LOOP_HPP_
+
+#include <climits>
+#include <cstdint>
+
+#include "mmu.hpp"
+
+namespace mjkgb {
+
+/* Detects busy-wait loops polling an I/O register, e.g.
+ *
+ *     wait: ldh a, (0x44)
+ *           cp 0x90
+ *           jr nz, wait
+ *
+ * Once the same loop has been seen to take the same number of cycles on two
+ * consecutive iterations, whole iterations can be skipped up until the polled
+ * register may next change value, or the next scheduled event. Since every
+ * skipped iteration would have read the same value and taken the branch, the
+ * machine state afterwards is identical to having run them.
+ */
+class IdleLoop {
+public:
+    enum : int { no_register = -1 };
+
+    IdleLoop()
+      : enabled_(true),
+        head_(0),
+        tail_(0),
+        register_(no_register),
+        last_clock_(0),
+        period_(0),
+        skipped_(0)
+    { }
+
+    /* Called on every taken backward branch from tail to head. Returns the
+     * number of cycles which may be skipped without passing deadline.
+     */
+    unsigned long branch(const Mmu &mmu, uint16_t head, uint16_t tail,
+            unsigned long clock, unsigned long deadline)
+    {
+        if (!enabled_)
+            return 0;
+
+        if (head != head_ || tail != tail_) {
+            head_ = head;
+            tail_ = tail;
+            register_ = poll_register(mmu, head, tail);
+            last_clock_ = clock;
+            period_ = 0;
+            return 0;
+        }
+
+        if (register_ == no_register)
+            return 0;
+
+        /* The register was last read during the iteration starting at
+         * last_clock_, so the value seen there must hold from then on.
+         */
+        auto start = last_clock_;
+        auto period = clock - last_clock_;
+        last_clock_ = clock;
+        if (period != period_) {
+            period_ = period;
+            return 0;
+        }
+
+        auto until = mmu.stable_until(static_cast<uint16_t>(register_), start);
+        if (deadline < until)
+            until = deadline;
+        if (until <= clock || until == ULONG_MAX ||
+                poll_register(mmu, head, tail) != register_)
+            return 0;
+
+        auto cycles = (until - clock) / period * period;
+        last_clock_ += cycles;
+        skipped_ += cycles;
+        return cycles;
+    }
+
+    inline void reset()
+    {
+        head_ = tail_ = 0;
+        register_ = no_register;
+    }
+
+    inline void set_enabled(bool enabled)
+    {
+        enabled_ = enabled;
+        reset();
+    }
+
+    inline unsigned long skipped() const
+    {
+        return skipped_;
+    }
+
+    /* Returns the address of the polled register if the code between head and
+     * tail is a read of an I/O register into A, a test of A against an
+     * immediate, and a conditional branch back to head.
+     */
+    static int poll_register(const Mmu &mmu, uint16_t head, uint16_t tail)
+    {
+        auto pc = head;
+        int address;
+
+        switch (mmu.peek(pc)) {
+        case 0xf0: /* LDH A, (n) */
+            address = Mmu::io_base | mmu.peek(pc + 1);
+            pc += 2;
+            break;
+        case 0xfa: /* LD A, (nn) */
+            address = mmu.peek(pc + 1) | mmu.peek(pc + 2) << 8;
+            if (address < Mmu::io_base)
+                return no_register;
+            pc += 3;
+            break;
+        default:
+            return no_register;
+        }
+
+        switch (mmu.peek(pc)) {
+        case 0xfe: /* CP n */
+        case 0xe6: /* AND n */
+            pc += 2;
+            break;
+        case 0xcb: /* BIT b, A */
+            if ((mmu.peek(pc + 1) & 0xc7) != 0x47)
+                return no_register;
+            pc += 2;
+            break;
+        default:
+            return no_register;
+        }
+
+        switch (mmu.peek(pc)) {
+        case 0x20: /* JR NZ, e */
+        case 0x28: /* JR Z, e */
+            if (static_cast<uint16_t>(pc + 2 + static_cast<int8_t>(mmu.peek(pc + 1))) != head)
+                return no_register;
+            pc += 2;
+            break;
+        case 0xc2: /* JP NZ, nn */
+        case 0xca: /* JP Z, nn */
+            if ((mmu.peek(pc + 1) | mmu.peek(pc + 2) << 8) != head)
+                return no_register;
+            pc += 3;
+            break;
+        default:
+            return no_register;
+        }
+
+        return pc == tail ? address : no_register;
+    }
+
+private:
+    bool enabled_;
+    uint16_t head_;
+    uint16_t tail_;
+    int register_;
+    unsigned long last_clock_;
+    unsigned long period_;
+    unsigned long skipped_;
+};
+
+}
+
+#endif /* IDLE_LOOP_HPP_ */
@@ -0,0 +1,399 @@
+#include <algorithm>
+
+#include "gameboy_impl.hpp"
+#include "jit.hpp"
+#include "mmu.hpp"
+
+namespace mjkgb {
+
+using namespace std;
+
+constexpr unsigned Jit::max_threshold;
+constexpr uint16_t Jit::rom_end;
+constexpr size_t Jit::max_instructions;
+constexpr size_t Jit::max_segments;
+constexpr unsigned Jit::max_optimize_threshold;
+constexpr unsigned Jit::default_optimize_threshold;
+constexpr uint16_t Jit::optimized_mark;
+
+namespace {
+
+/* STOP is 1 as the interpreter doesn't consume its padding byte */
+const uint8_t lengths[256] = {
+    1, 3, 1, 1, 1, 1, 2, 1, 3, 1, 1, 1, 1, 1, 2, 1,
+    1, 3, 1, 1, 1, 1, 2, 1, 2, 1, 1, 1, 1, 1, 2, 1,
+    2, 3, 1, 1, 1, 1, 2, 1, 2, 1, 1, 1, 1, 1, 2, 1,
+    2, 3, 1, 1, 1, 1, 2, 1, 2, 1, 1, 1, 1, 1, 2, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 3, 3, 3, 1, 2, 1, 1, 1, 3, 2, 3, 3, 2, 1,
+    1, 1, 3, 1, 3, 1, 2, 1, 1, 1, 3, 1, 3, 1, 2, 1,
+    2, 1, 1, 1, 1, 1, 2, 1, 2, 1, 3, 1, 1, 1, 2, 1,
+    2, 1, 1, 1, 1, 1, 2, 1, 2, 1, 3, 1, 1, 1, 2, 1,
+};
+
+const bool jumps[256] = {
+#define X(name, def, is_jump, cycles) is_jump,
+#include "opcode_map.in"
+#undef X
+};
+
+/* Clock ticks each instruction takes through the accessors, fetching
+ * included, as the interpreter and the compiled wrappers count them. These
+ * are not the maps' cycles: every fetched byte and register pair write ticks.
+ * Conditional jumps are counted as taken, the longer way.
+ */
+const uint8_t ticks[256] = {
+    2, 6, 4, 3, 2, 2, 4, 2, 7, 3, 3, 3, 2, 2, 4, 2,
+    2, 6, 4, 3, 2, 2, 4, 2, 5, 3, 3, 3, 2, 2, 4, 2,
+    5, 6, 5, 3, 2, 2, 4, 2, 5, 3, 4, 3, 2, 2, 4, 2,
+    5, 6, 4, 3, 6, 6, 6, 2, 5, 3, 4, 3, 2, 2, 4, 2,
+    2, 2, 2, 2, 2, 2, 3, 2, 2, 2, 2, 2, 2, 2, 3, 2,
+    2, 2, 2, 2, 2, 2, 3, 2, 2, 2, 2, 2, 2, 2, 3, 2,
+    2, 2, 2, 2, 2, 2, 3, 2, 2, 2, 2, 2, 2, 2, 3, 2,
+    3, 3, 3, 3, 3, 3, 2, 3, 2, 2, 2, 2, 2, 2, 3, 2,
+    2, 2, 2, 2, 2, 2, 3, 2, 2, 2, 2, 2, 2, 2, 3, 2,
+    2, 2, 2, 2, 2, 2, 3, 2, 2, 2, 2, 2, 2, 2, 3, 2,
+    2, 2, 2, 2, 2, 2, 3, 2, 2, 2, 2, 2, 2, 2, 3, 2,
+    2, 2, 2, 2, 2, 2, 3, 2, 2, 2, 2, 2, 2, 2, 3, 2,
+    7, 6, 6, 6, 8, 5, 4, 5, 7, 6, 6, 2, 8, 8, 4, 5,
+    7, 6, 6, 2, 8, 5, 4, 5, 7, 6, 6, 2, 8, 2, 4, 5,
+    5, 6, 3, 2, 2, 5, 4, 5, 6, 3, 6, 2, 2, 2, 4, 5,
+    5, 6, 3, 2, 2, 5, 4, 5, 5, 3, 6, 2, 2, 2, 4, 5,
+};
+
+/* Following the CB prefix, whose ticks are counted above */
+const uint8_t cb_ticks[256] = {
+    2, 2, 2, 2, 2, 2, 4, 2, 2, 2, 2, 2, 2, 2, 4, 2,
+    2, 2, 2, 2, 2, 2, 4, 2, 2, 2, 2, 2, 2, 2, 4, 2,
+    2, 2, 2, 2, 2, 2, 4, 2, 2, 2, 2, 2, 2, 2, 4, 2,
+    2, 2, 2, 2, 2, 2, 4, 2, 2, 2, 2, 2, 2, 2, 4, 2,
+    2, 2, 2, 2, 2, 2, 4, 2, 2, 2, 2, 2, 2, 2, 4, 2,
+    2, 2, 2, 2, 2, 2, 4, 2, 2, 2, 2, 2, 2, 2, 4, 2,
+    2, 2, 2, 2, 2, 2, 4, 2, 2, 2, 2, 2, 2, 2, 4, 2,
+    2, 2, 2, 2, 2, 2, 4, 2, 2, 2, 2, 2, 2, 2, 4, 2,
+    2, 2, 2, 2, 2, 2, 4, 2, 2, 2, 2, 2, 2, 2, 4, 2,
+    2, 2, 2, 2, 2, 2, 4, 2, 2, 2, 2, 2, 2, 2, 4, 2,
+    2, 2, 2, 2, 2, 2, 4, 2, 2, 2, 2, 2, 2, 2, 4, 2,
+    2, 2, 2, 2, 2, 2, 4, 2, 2, 2, 2, 2, 2, 2, 4, 2,
+    2, 2, 2, 2, 2, 2, 4, 2, 2, 2, 2, 2, 2, 2, 4, 2,
+    2, 2, 2, 2, 2, 2, 4, 2, 2, 2, 2, 2, 2, 2, 4, 2,
+    2, 2, 2, 2, 2, 2, 4, 2, 2, 2, 2, 2, 2, 2, 4, 2,
+    2, 2, 2, 2, 2, 2, 4, 2, 2, 2, 2, 2, 2, 2, 4, 2,
+};
+
+constexpr uint8_t stop_opcode = 0x10;
+constexpr uint8_t cb_opcode = 0xcb;
+
+/* Where control can go from an instruction */
+struct Flow {
+    /* May jump, to target if it is known statically */
+    bool jumps;
+    bool known;
+    unsigned target;
+
+    /* May carry on to the next instruction, or return to it from a call */
+    bool falls;
+    bool returns;
+    unsigned next;
+};
+
+Flow flow_at(const Mmu &mmu, unsigned address)
+{
+    auto opcode = mmu.peek(static_cast<uint16_t>(address));
+    auto next = address + Jit::length(opcode);
+    auto word = mmu.peek(static_cast<uint16_t>(address + 1)) |
+        mmu.peek(static_cast<uint16_t>(address + 2)) << 8;
+    auto offset = static_cast<int8_t>(mmu.peek(static_cast<uint16_t>(address + 1)));
+
+    Flow flow{Jit::is_jump(opcode), false, 0, opcode != stop_opcode, false, next};
+    if (Jit::is_jump(opcode))
+        flow.falls = Jit::is_conditional(opcode);
+
+    switch (opcode) {
+    /* JR, JR cc */
+    case 0x18:
+    case 0x20: case 0x28: case 0x30: case 0x38:
+        flow.known = true;
+        flow.target = static_cast<uint16_t>(next + offset);
+        break;
+    /* JP, JP cc */
+    case 0xc3:
+    case 0xc2: case 0xca: case 0xd2: case 0xda:
+        flow.known = true;
+        flow.target = word;
+        break;
+    /* CALL, CALL cc */
+    case 0xcd:
+    case 0xc4: case 0xcc: case 0xd4: case 0xdc:
+        flow.known = true;
+        flow.target = word;
+        flow.returns = true;
+        break;
+    /* RST */
+    case 0xc7: case 0xcf: case 0xd7: case 0xdf:
+    case 0xe7: case 0xef: case 0xf7: case 0xff:
+        flow.known = true;
+        flow.target = opcode & 0x38;
+        flow.returns = true;
+        break;
+    }
+
+    return flow;
+}
+
+uintptr_t jit_hook(GameboyImpl &gb, uint16_t address, uintptr_t native)
+{
+    return native ? gb.jit_.enter(gb, address, native) : gb.jit_.visit(gb, address);
+}
+
+}
+
+void Jit::set_threshold(unsigned threshold)
+{
+    threshold_ = min(threshold, max_threshold);
+    hook_ = threshold_ ? jit_hook : nullptr;
+    if (threshold_ && heat_.empty()) {
+        heat_.resize(rom_end);
+        entries_.resize(rom_end);
+    }
+}
+
+void Jit::set_optimize_threshold(unsigned threshold)
+{
+    optimize_threshold_ = min(threshold, max_optimize_threshold);
+}
+
+void Jit::clear()
+{
+    fill(heat_.begin(), heat_.end(), 0);
+    fill(entries_.begin(), entries_.end(), 0);
+}
+
+uintptr_t Jit::visit(GameboyImpl &gb, uint16_t address)
+{
+    if (address >= rom_end || !gb.code_)
+        return 0;
+
+    /* Another machine running the same ROM may have compiled it already */
+    auto entry = gb.code_->find(gb.mmu_, address);
+    if (!entry) {
+        /* Counts stop at the threshold, so a block which fails to compile
+         * isn't tried again
+         */
+        auto &heat = heat_[address];
+        if (heat >= threshold_ || ++heat < threshold_)
+            return 0;
+
+        entry = gb.code_->compile(gb.mmu_, address);
+        if (!entry)
+            return 0;
+        ++compiled_;
+    }
+
+    entries_[address] = entry->optimized ? optimized_mark : 0;
+    gb.mmu_.set_native(address, entry->native);
+    return entry->native;
+}
+
+uintptr_t Jit::enter(GameboyImpl &gb, uint16_t address, uintptr_t native)
+{
+    if (address >= rom_end || !gb.code_ || !optimize_threshold_)
+        return native;
+
+    /* As with compiling, a block which fails to optimize isn't tried again */
+    auto &entries = entries_[address];
+    if (entries == optimized_mark || ++entries < optimize_threshold_)
+        return native;
+    entries = optimized_mark;
+
+    auto entry = gb.code_->optimize(gb.mmu_, address);
+    if (!entry)
+        return native;
+
+    ++optimized_;
+    gb.mmu_.set_native(address, entry->native);
+    return entry->native;
+}
+
+vector<uint8_t> Jit::decode(const Mmu &mmu, uint16_t address)
+{
+    vector<uint8_t> block;
+    for (size_t i = 0; i < max_instructions && address < rom_end; ++i) {
+        auto opcode = mmu.peek(address);
+        for (unsigned byte = 0; byte < length(opcode); ++byte)
+            block.push_back(mmu.peek(static_cast<uint16_t>(address + byte)));
+        address = static_cast<uint16_t>(address + length(opcode));
+
+        if (is_jump(opcode) || opcode == stop_opcode)
+            break;
+    }
+    return block;
+}
+
+vector<uint16_t> Jit::discover(const Mmu &mmu)
+{
+    vector<bool> targets(rom_end), scanned(rom_end);
+    vector<uint16_t> pending;
+    auto target = [&](unsigned address) {
+        if (address < rom_end && !targets[address]) {
+            targets[address] = true;
+            pending.push_back(static_cast<uint16_t>(address));
+        }
+    };
+
+    /* RST and interrupt vectors, and the cartridge entry point */
+    for (unsigned address = 0; address <= 0x60; address += 8)
+        target(address);
+    target(0x100);
+
+    while (!pending.empty()) {
+        unsigned address = pending.back();
+        pending.pop_back();
+
+        /* Conditional jumps fall through without jumping, so the code after
+         * them is scanned for further jumps but isn't itself a target
+         */
+        while (address < rom_end && !scanned[address]) {
+            scanned[address] = true;
+
+            auto flow = flow_at(mmu, address);
+            if (flow.known)
+                target(flow.target);
+            if (flow.returns)
+                target(flow.next);
+            if (!flow.falls)
+                break;
+            address = flow.next;
+        }
+    }
+
+    vector<uint16_t> addresses;
+    for (unsigned address = 0; address < rom_end; ++address)
+        if (targets[address])
+            addresses.push_back(static_cast<uint16_t>(address));
+    return addresses;
+}
+
+Compiler::block_list Jit::trace(const Mmu &mmu, uint16_t address,
+        const BranchCounts *branches, bool &loops)
+{
+    Compiler::block_list trace;
+    loops = false;
+
+    unsigned start = address;
+    while (trace.size() < max_segments) {
+        auto block = decode(mmu, static_cast<uint16_t>(start));
+
+        /* The block's last instruction decides where it goes */
+        unsigned last = start;
+        for (size_t i = 0; i < block.size(); i += length(block[i]))
+            last = start + static_cast<unsigned>(i);
+        trace.emplace_back(static_cast<uint16_t>(start), move(block));
+
+        auto flow = flow_at(mmu, last);
+        unsigned next;
+        if (flow.jumps && flow.falls) {
+            auto taken = false;
+            if (branches) {
+                const auto &counts = branches[flow.next];
+                taken = counts.taken.load(memory_order_relaxed) >
+                    counts.not_taken.load(memory_order_relaxed);
+            }
+            if (taken && !flow.known)
+                break;
+            next = taken ? flow.target : flow.next;
+        } else if (flow.jumps) {
+            if (!flow.known)
+                break;
+            next = flow.target;
+        } else if (flow.falls) {
+            next = flow.next;
+        } else {
+            break;
+        }
+
+        if (next == address) {
+            loops = true;
+            break;
+        }
+
+        /* Code already in the trace is left to jump to, so each block is
+         * compiled at most once
+         */
+        auto seen = false;
+        for (const auto &segment : trace)
+            seen = seen || segment.first == next;
+        if (next >= rom_end || seen)
+            break;
+        start = next;
+    }
+
+    return trace;
+}
+
+unsigned Jit::cycles(const vector<uint8_t> &block)
+{
+    unsigned total = 0;
+    for (size_t i = 0; i < block.size(); i += length(block[i])) {
+        total += ticks[block[i]];
+        if (block[i] == cb_opcode)
+            total += cb_ticks[block[i + 1]];
+    }
+    return total;
+}
+
+unsigned Jit::length(uint8_t opcode)
+{
+    return lengths[opcode];
+}
+
+bool Jit::is_jump(uint8_t opcode)
+{
+    return jumps[opcode];
+}
+
+bool Jit::is_conditional(uint8_t opcode)
+{
+    return (opcode & 0xe7) == 0x20 || (opcode & 0xe7) == 0xc0 ||
+        (opcode & 0xe7) == 0xc2 || (opcode & 0xe7) == 0xc4;
+}
+
+bool Jit::may_schedule(const uint8_t *instruction)
+{
+    auto opcode = instruction[0];
+    switch (opcode) {
+    /* EI */
+    case 0xfb:
+        return true;
+    /* LD (nn), A, unless nn is below the I/O page */
+    case 0xea:
+        return instruction[2] == 0xff;
+    /* LDH (n), A, unless n is in HRAM */
+    case 0xe0:
+        return instruction[1] < 0x80 || instruction[1] == 0xff;
+    /* LD (BC), A; LD (DE), A; LD (HL+), A; LD (HL-), A; LD (nn), SP;
+     * LD (C), A
+     */
+    case 0x02: case 0x12: case 0x22: case 0x32: case 0x08: case 0xe2:
+    /* INC (HL); DEC (HL); LD (HL), n */
+    case 0x34: case 0x35: case 0x36:
+    /* PUSH */
+    case 0xc5: case 0xd5: case 0xe5: case 0xf5:
+        return true;
+    /* RLC (HL) through SET 7, (HL), apart from BIT, which only reads */
+    case cb_opcode:
+        return (instruction[1] & 7) == 6 && (instruction[1] < 0x40 || instruction[1] >= 0x80);
+    default:
+        /* LD (HL), r, but not HALT */
+        return opcode >= 0x70 && opcode < 0x78 && opcode != 0x76;
+    }
+}
+
+}
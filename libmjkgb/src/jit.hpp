@@ -0,0 +1,154 @@
+#ifndef JIT_HPP_
+#define JIT_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "compiler.hpp"
+
+namespace mjkgb {
+
+struct GameboyImpl;
+class Mmu;
+
+/* Decides which blocks to compile. Every jump to an address without native
+ * code counts towards that address, and the block starting there is compiled
+ * once it has been jumped to threshold times. A threshold of 1 compiles
+ * everything reached by a jump, 0 disables compilation entirely.
+ *
+ * Blocks are first compiled at the baseline tier, which is quick to generate.
+ * Entries into baseline code are counted in turn, and a block entered
+ * optimize threshold times is recompiled at the optimized tier and swapped
+ * into the native table in place of the baseline code. The optimized unit is
+ * a trace, which carries on through the blocks that the block's branches
+ * were mostly seen to lead to, returning to the dispatch loop only where
+ * execution goes another way. A trace leading back to its start is a loop.
+ *
+ * Only ROM is compiled. The MMU drops writes to it, so compiled code stays
+ * valid until a different ROM is loaded, and nothing needs to watch for
+ * code being modified.
+ */
+class Jit {
+public:
+    using hook = uintptr_t (*)(GameboyImpl &, uint16_t, uintptr_t);
+
+    static constexpr unsigned max_threshold = UINT8_MAX;
+    static constexpr unsigned max_optimize_threshold = UINT16_MAX - 1;
+    static constexpr unsigned default_optimize_threshold = 1000;
+    static constexpr uint16_t rom_end = 0x8000;
+    static constexpr size_t max_instructions = 64;
+    static constexpr size_t max_segments = 8;
+
+    Jit()
+      : hook_(nullptr),
+        threshold_(0),
+        optimize_threshold_(default_optimize_threshold),
+        compiled_(0),
+        optimized_(0),
+        heat_(),
+        entries_()
+    { }
+
+    /* Called on every jump with the target's native code if it has any,
+     * null while disabled so that the interpreter pays only for the check.
+     * Returns the native code to run, which may have just been compiled or
+     * recompiled.
+     */
+    inline hook get_hook() const
+    {
+        return hook_;
+    }
+
+    inline unsigned threshold() const
+    {
+        return threshold_;
+    }
+
+    inline unsigned optimize_threshold() const
+    {
+        return optimize_threshold_;
+    }
+
+    /* Number of blocks this machine has compiled */
+    inline size_t compiled() const
+    {
+        return compiled_;
+    }
+
+    /* Number of blocks this machine has swapped to optimized code */
+    inline size_t optimized() const
+    {
+        return optimized_;
+    }
+
+    void set_threshold(unsigned threshold);
+
+    /* 0 leaves everything at the baseline tier */
+    void set_optimize_threshold(unsigned threshold);
+
+    /* Forget how often each address has been jumped to, for a new ROM */
+    void clear();
+
+    /* A jump to address, which has no native code */
+    uintptr_t visit(GameboyImpl &gb, uint16_t address);
+
+    /* A jump to address, which has native code */
+    uintptr_t enter(GameboyImpl &gb, uint16_t address, uintptr_t native);
+
+    /* Bytes of the instructions of the block starting at address, operands
+     * included, since optimized code has them built in. A block ends after
+     * its first jump or STOP, at the end of ROM or after max_instructions.
+     */
+    static std::vector<uint8_t> decode(const Mmu &mmu, uint16_t address);
+
+    /* Addresses of the ROM which can be statically found to be jumped to,
+     * in order. Code is followed from the reset and interrupt vectors through
+     * every jump, call and return with a target known without running it.
+     * Anything reached only through JP (HL) or a computed return is missed.
+     */
+    static std::vector<uint16_t> discover(const Mmu &mmu);
+
+    /* Blocks from address along the direction each conditional branch was
+     * most often taken, according to branches. Sets loops if the last block
+     * leads back to the first.
+     */
+    static Compiler::block_list trace(const Mmu &mmu, uint16_t address,
+            const BranchCounts *branches, bool &loops);
+
+    /* Most clock ticks the instructions of block can take, with every
+     * conditional branch taken
+     */
+    static unsigned cycles(const std::vector<uint8_t> &block);
+
+    /* Length in bytes of the instruction starting with opcode, as the
+     * interpreter executes it
+     */
+    static unsigned length(uint8_t opcode);
+    static bool is_jump(uint8_t opcode);
+
+    /* Jumps which can also fall through, JR cc, JP cc, CALL cc and RET cc */
+    static bool is_conditional(uint8_t opcode);
+
+    /* Whether the instruction, operands included, can schedule an event:
+     * EI, and writes which may reach the I/O registers, such as IF and IE,
+     * the timer, LCDC or DMA. Jumps are left out, as they end blocks anyway.
+     */
+    static bool may_schedule(const uint8_t *instruction);
+
+private:
+    /* Entry counts stop here once a block is optimized */
+    static constexpr uint16_t optimized_mark = UINT16_MAX;
+
+    hook hook_;
+    unsigned threshold_;
+    unsigned optimize_threshold_;
+    size_t compiled_;
+    size_t optimized_;
+    std::vector<uint8_t> heat_;
+    std::vector<uint16_t> entries_;
+};
+
+}
+
+#endif /* JIT_HPP_ */
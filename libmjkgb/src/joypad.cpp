@@ -0,0 +1,118 @@
+#include <algorithm>
+
+#include "gameboy_impl.hpp"
+#include "joypad.hpp"
+#include "mmu.hpp"
+#include "scheduler.hpp"
+#include "state.hpp"
+
+namespace mjkgb {
+
+using namespace std;
+
+constexpr uint16_t Joypad::joyp_address;
+
+namespace {
+
+uint8_t read_joypad(GameboyImpl &gb, uint16_t)
+{
+    return gb.joypad_.joyp();
+}
+
+void write_joypad(GameboyImpl &gb, uint16_t, uint8_t value)
+{
+    gb.joypad_.set_select(gb, value);
+}
+
+/* The buttons only change between runs or on an INPUT event */
+unsigned long joypad_stable_until(GameboyImpl &, uint16_t, unsigned long)
+{
+    return Scheduler::never;
+}
+
+void joypad_input(GameboyImpl &gb)
+{
+    gb.joypad_.update(gb, gb.cpu_.get_clock());
+}
+
+}
+
+void Joypad::set_select(GameboyImpl &gb, uint8_t value)
+{
+    change(gb, value & 0x30, buttons_);
+}
+
+void Joypad::set_buttons(GameboyImpl &gb, uint8_t buttons)
+{
+    change(gb, select_, buttons);
+}
+
+void Joypad::queue(GameboyImpl &gb, unsigned long clock, uint8_t buttons)
+{
+    auto later = upper_bound(queue_.begin(), queue_.end(), clock,
+            [](unsigned long at, const pair<unsigned long, uint8_t> &entry) {
+        return at < entry.first;
+    });
+    queue_.emplace(later, clock, buttons);
+    reschedule(gb.scheduler_);
+}
+
+void Joypad::clear_queue(GameboyImpl &gb)
+{
+    queue_.clear();
+    reschedule(gb.scheduler_);
+}
+
+void Joypad::update(GameboyImpl &gb, unsigned long clock)
+{
+    while (!queue_.empty() && queue_.front().first <= clock) {
+        change(gb, select_, queue_.front().second);
+        queue_.pop_front();
+    }
+    reschedule(gb.scheduler_);
+}
+
+void Joypad::reset()
+{
+    select_ = 0x30;
+    queue_.clear();
+}
+
+void Joypad::save_state(StateWriter &state) const
+{
+    state.put(select_);
+    state.put(buttons_);
+}
+
+void Joypad::load_state(StateReader &state, Scheduler &scheduler)
+{
+    state.get(select_);
+    state.get(buttons_);
+    queue_.clear();
+    reschedule(scheduler);
+}
+
+void Joypad::change(GameboyImpl &gb, uint8_t select, uint8_t buttons)
+{
+    auto before = lines();
+    select_ = select;
+    buttons_ = buttons;
+    if (lines() & ~before)
+        gb.request_interrupt(Interrupt::JOYPAD);
+}
+
+void Joypad::reschedule(Scheduler &scheduler)
+{
+    if (queue_.empty())
+        scheduler.cancel(Event::INPUT);
+    else
+        scheduler.schedule(Event::INPUT, queue_.front().first);
+}
+
+void Joypad::attach(Mmu &mmu, Scheduler &scheduler)
+{
+    mmu.set_io_handler(joyp_address, { read_joypad, write_joypad, joypad_stable_until });
+    scheduler.set_handler(Event::INPUT, joypad_input);
+}
+
+}
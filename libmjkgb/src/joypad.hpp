@@ -0,0 +1,95 @@
+#ifndef JOYPAD_HPP_
+#define JOYPAD_HPP_
+
+#include <cstdint>
+#include <deque>
+#include <utility>
+
+namespace mjkgb {
+
+struct GameboyImpl;
+class Mmu;
+class Scheduler;
+class StateReader;
+class StateWriter;
+
+/* The joypad register and the buttons held by the host. Buttons are a mask
+ * with the directions in the low nibble and A, B, Select and Start in the
+ * high nibble, matching the lines each half of the register reads.
+ *
+ * Besides being set directly, changes can be queued ahead of time. The
+ * earliest queued change is scheduled as an INPUT event, so scripted input
+ * for many frames is applied without returning to the host.
+ */
+class Joypad {
+public:
+    static constexpr uint16_t joyp_address = 0xff00;
+
+    Joypad()
+      : select_(0x30),
+        buttons_(0),
+        queue_()
+    { }
+
+    /* Selected lines read low while their button is held */
+    inline uint8_t joyp() const
+    {
+        return static_cast<uint8_t>(0xc0 | select_ | (~lines() & 0x0f));
+    }
+
+    inline uint8_t buttons() const
+    {
+        return buttons_;
+    }
+
+    inline bool queued() const
+    {
+        return !queue_.empty();
+    }
+
+    void set_select(GameboyImpl &gb, uint8_t value);
+    void set_buttons(GameboyImpl &gb, uint8_t buttons);
+
+    /* Hold buttons from clock onwards. Changes queued for the same clock are
+     * applied in the order they were queued.
+     */
+    void queue(GameboyImpl &gb, unsigned long clock, uint8_t buttons);
+    void clear_queue(GameboyImpl &gb);
+
+    /* Apply every queued change due at or before clock */
+    void update(GameboyImpl &gb, unsigned long clock);
+
+    /* The held buttons are left alone, they belong to the host */
+    void reset();
+
+    /* Queued changes are host input rather than machine state, so they are
+     * neither saved nor kept across a load
+     */
+    void save_state(StateWriter &state) const;
+    void load_state(StateReader &state, Scheduler &scheduler);
+
+    void attach(Mmu &mmu, Scheduler &scheduler);
+
+private:
+    inline uint8_t lines() const
+    {
+        uint8_t lines = 0;
+        if (!(select_ & 0x10))
+            lines |= buttons_ & 0x0f;
+        if (!(select_ & 0x20))
+            lines |= buttons_ >> 4;
+        return lines;
+    }
+
+    /* Requests the joypad interrupt if any line goes low */
+    void change(GameboyImpl &gb, uint8_t select, uint8_t buttons);
+    void reschedule(Scheduler &scheduler);
+
+    uint8_t select_;
+    uint8_t buttons_;
+    std::deque<std::pair<unsigned long, uint8_t>> queue_;
+};
+
+}
+
+#endif /* JOYPAD_HPP_ */
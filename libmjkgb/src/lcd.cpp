@@ -0,0 +1,71 @@
+#include "gameboy_impl.hpp"
+#include "lcd.hpp"
+#include "mmu.hpp"
+#include "scheduler.hpp"
+
+namespace mjkgb {
+
+using namespace std;
+
+constexpr unsigned long Lcd::cycles_per_line;
+constexpr unsigned long Lcd::lines_per_frame;
+constexpr unsigned long Lcd::cycles_per_frame;
+constexpr unsigned long Lcd::vblank_line;
+constexpr uint16_t Lcd::stat_address;
+constexpr uint16_t Lcd::ly_address;
+constexpr uint16_t Lcd::lyc_address;
+
+namespace {
+
+uint8_t read_stat(GameboyImpl &gb, uint16_t address)
+{
+    auto clock = gb.cpu_.get_clock();
+    auto coincidence = gb.lcd_.ly(clock) == gb.mmu_.peek(Lcd::lyc_address);
+    return 0x80 | (gb.mmu_.peek(address) & 0x78) |
+        (coincidence ? 0x04 : 0x00) | gb.lcd_.mode(clock);
+}
+
+void write_stat(GameboyImpl &gb, uint16_t address, uint8_t value)
+{
+    gb.mmu_.poke(address, value & 0x78);
+}
+
+unsigned long stat_stable_until(GameboyImpl &gb, uint16_t, unsigned long clock)
+{
+    return gb.lcd_.next_mode(clock);
+}
+
+uint8_t read_ly(GameboyImpl &gb, uint16_t)
+{
+    return gb.lcd_.ly(gb.cpu_.get_clock());
+}
+
+void write_ly(GameboyImpl &, uint16_t, uint8_t)
+{ }
+
+unsigned long ly_stable_until(GameboyImpl &gb, uint16_t, unsigned long clock)
+{
+    return gb.lcd_.next_line(clock);
+}
+
+void lcd_vblank(GameboyImpl &gb)
+{
+    gb.lcd_.reset(gb);
+    gb.vblank();
+}
+
+}
+
+void Lcd::reset(GameboyImpl &gb)
+{
+    gb.scheduler_.schedule(Event::VBLANK, next_vblank(gb.cpu_.get_clock()));
+}
+
+void Lcd::attach(Mmu &mmu, Scheduler &scheduler)
+{
+    mmu.set_io_handler(stat_address, { read_stat, write_stat, stat_stable_until });
+    mmu.set_io_handler(ly_address, { read_ly, write_ly, ly_stable_until });
+    scheduler.set_handler(Event::VBLANK, lcd_vblank);
+}
+
+}
@@ -0,0 +1,82 @@
+#ifndef LCD_HPP_
+#define LCD_HPP_
+
+#include <cstdint>
+
+namespace mjkgb {
+
+struct GameboyImpl;
+class Mmu;
+class Scheduler;
+
+/* LCD controller timing. Rather than stepping a dot counter every tick, the
+ * current line and mode are derived from the cycle counter whenever LY or STAT
+ * are read. The only scheduled event is the start of each VBlank.
+ */
+class Lcd {
+public:
+    static constexpr unsigned long cycles_per_line = 114;
+    static constexpr unsigned long lines_per_frame = 154;
+    static constexpr unsigned long cycles_per_frame =
+        cycles_per_line * lines_per_frame;
+    static constexpr unsigned long vblank_line = 144;
+
+    static constexpr uint16_t stat_address = 0xff41;
+    static constexpr uint16_t ly_address = 0xff44;
+    static constexpr uint16_t lyc_address = 0xff45;
+
+    inline uint8_t ly(unsigned long clock) const
+    {
+        return static_cast<uint8_t>((clock / cycles_per_line) % lines_per_frame);
+    }
+
+    /* 0 - HBlank, 1 - VBlank, 2 - OAM search, 3 - pixel transfer */
+    inline uint8_t mode(unsigned long clock) const
+    {
+        if (ly(clock) >= vblank_line)
+            return 1;
+
+        auto dot = clock % cycles_per_line;
+        if (dot < oam_cycles)
+            return 2;
+        else if (dot < oam_cycles + transfer_cycles)
+            return 3;
+        else
+            return 0;
+    }
+
+    inline unsigned long next_line(unsigned long clock) const
+    {
+        return (clock / cycles_per_line + 1) * cycles_per_line;
+    }
+
+    inline unsigned long next_mode(unsigned long clock) const
+    {
+        auto line_start = clock - clock % cycles_per_line;
+        if (ly(clock) < vblank_line) {
+            if (clock < line_start + oam_cycles)
+                return line_start + oam_cycles;
+            else if (clock < line_start + oam_cycles + transfer_cycles)
+                return line_start + oam_cycles + transfer_cycles;
+        }
+        return next_line(clock);
+    }
+
+    inline unsigned long next_vblank(unsigned long clock) const
+    {
+        auto vblank = clock - clock % cycles_per_frame + vblank_line * cycles_per_line;
+        return clock < vblank ? vblank : vblank + cycles_per_frame;
+    }
+
+    void reset(GameboyImpl &gb);
+
+    void attach(Mmu &mmu, Scheduler &scheduler);
+
+private:
+    static constexpr unsigned long oam_cycles = 20;
+    static constexpr unsigned long transfer_cycles = 43;
+};
+
+}
+
+#endif /* LCD_HPP_ */
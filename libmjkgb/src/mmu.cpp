@@ -1,14 +1,66 @@
+#include <bitset>
+#include <cstring>
 #include <istream>
+#include <memory>
 
 #include "mmu.hpp"
+#include "state.hpp"
 
 namespace mjkgb {
 
 using namespace std;
 
+constexpr uint16_t Mmu::io_base;
+constexpr int Mmu::memory_size;
+constexpr int Mmu::page_size;
+constexpr int Mmu::num_pages;
+constexpr int Mmu::rom_pages;
+
+Mmu::Mmu(GameboyImpl &gb, const Mmu &other)
+  : gb_(gb),
+    memory_(other.memory_),
+    map_(),
+    write_map_(),
+    dirty_(other.dirty_),
+    native_(other.native_),
+    io_(other.io_)
+{
+    for (int page = 0; page < num_pages; ++page) {
+        map_[page] = other.map_[page] ? &memory_[page * page_size] : nullptr;
+        write_map_[page] = other.write_map_[page] ? &memory_[page * page_size] : nullptr;
+    }
+}
+
 void Mmu::set_native(uint16_t address, uintptr_t func)
 {
-    native_[address].store(func);
+    (*native_)[address].store(func);
+}
+
+void Mmu::set_io_handler(uint16_t address, IoHandler handler)
+{
+    io_[address & 0xff] = handler;
+}
+
+void Mmu::map_all()
+{
+    for (int page = 0; page < num_pages; ++page) {
+        map_[page] = page == io_page ? nullptr : &memory_[page * page_size];
+        write_map_[page] = page < rom_pages ? nullptr : map_[page];
+    }
+}
+
+void Mmu::unmap_all()
+{
+    map_.fill(nullptr);
+    write_map_.fill(nullptr);
+}
+
+void Mmu::copy(uint16_t dst, uint16_t src, size_t size)
+{
+    memmove(&memory_[dst], &memory_[src], size);
+    for (size_t address = dst; address < dst + size; address += page_size)
+        mark_dirty(static_cast<uint16_t>(address));
+    mark_dirty(static_cast<uint16_t>(dst + size - 1));
 }
 
 void Mmu::load(istream &is)
@@ -16,6 +68,47 @@ void Mmu::load(istream &is)
     memory_.fill(0);
     is.read(reinterpret_cast<char *>(memory_.data()),
             static_cast<long>(memory_.size()));
+    dirty_ = all_pages();
+
+    /* Code compiled for the previous contents no longer applies */
+    native_ = make_shared<native_table>();
+}
+
+int Mmu::count(const page_set &pages)
+{
+    auto total = 0;
+    for (auto word : pages)
+        total += static_cast<int>(bitset<64>(word).count());
+    return total;
+}
+
+void Mmu::save_state(StateWriter &state, const page_set &pages) const
+{
+    for (int page = 0; page < num_pages; ++page)
+        if (contains(pages, page))
+            state.put(&memory_[page * page_size], page_size);
+}
+
+bool Mmu::load_state(StateReader &state, const page_set &pages)
+{
+    auto rom_changed = false;
+    for (int page = 0; page < num_pages; ++page) {
+        if (!contains(pages, page))
+            continue;
+
+        auto offset = page * page_size;
+        auto data = state.bytes(page_size);
+        if (page < rom_pages && memcmp(&memory_[offset], data, page_size))
+            rom_changed = true;
+        memcpy(&memory_[offset], data, page_size);
+    }
+
+    /* A fresh table rather than clearing this one, which clones still running
+     * the old ROM share
+     */
+    if (rom_changed)
+        native_ = make_shared<native_table>();
+    return rom_changed;
 }
 
 }
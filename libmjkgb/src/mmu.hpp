@@ -1,50 +1,242 @@
 #ifndef MMU_HPP_
 #define MMU_HPP_
 
+#include <algorithm>
 #include <array>
 #include <atomic>
+#include <climits>
+#include <cstddef>
 #include <cstdint>
+#include <cstring>
 #include <iosfwd>
+#include <memory>
 #include <string>
 
 namespace mjkgb {
 
 struct GameboyImpl;
+class StateReader;
+class StateWriter;
+
+/* Hooks for memory mapped I/O registers. Handlers are reached through function
+ * pointers so that JIT compiled code can call them without needing to resolve
+ * any symbols from the host binary.
+ *
+ * stable_until returns the clock value before which reads of the register made
+ * at or after the given clock are guaranteed to all return the same value, or 0
+ * if this isn't known. Registers without handlers only change when written,
+ * either by the CPU or by a scheduled event.
+ */
+struct IoHandler {
+    uint8_t (*read)(GameboyImpl &, uint16_t);
+    void (*write)(GameboyImpl &, uint16_t, uint8_t);
+    unsigned long (*stable_until)(GameboyImpl &, uint16_t, unsigned long);
+};
 
 class Mmu {
 public:
-    Mmu()
-      : memory_(),
-        native_()
-    { }
+    static constexpr uint16_t io_base = 0xff00;
+
+    static constexpr int memory_size = 1 << 16;
+    static constexpr int page_size = 1 << 8;
+    static constexpr int num_pages = memory_size / page_size;
+
+    /* Bitmap with one bit per page */
+    using page_set = std::array<uint64_t, num_pages / 64>;
+
+    /* Bank of address as debuggers show it. Without bank switching that's
+     * 1 for the upper half of ROM, and 0 everywhere else.
+     */
+    static inline unsigned bank(uint16_t address)
+    {
+        return address >= 0x4000 && address < 0x8000 ? 1 : 0;
+    }
+
+    explicit Mmu(GameboyImpl &gb)
+      : gb_(gb),
+        memory_(),
+        map_(),
+        write_map_(),
+        dirty_(),
+        native_(std::make_shared<native_table>()),
+        io_()
+    {
+        map_all();
+    }
+
+    /* Copy of other for a new machine. The two run the same ROM, so they
+     * share one table of compiled code, and code either installs is valid for
+     * both. Loading a state with different ROM gives a machine a table of its
+     * own.
+     */
+    Mmu(GameboyImpl &gb, const Mmu &other);
+
+    Mmu(const Mmu &) = delete;
+    Mmu &operator=(const Mmu &) = delete;
 
     inline uint8_t get(uint16_t address) const
     {
-        return memory_[address];
+        auto page = map_[address >> 8];
+        if (page)
+            return page[address & 0xff];
+        return get_unmapped(address);
     }
 
     inline void set(uint16_t address, uint8_t value)
+    {
+        auto page = write_map_[address >> 8];
+        if (page) {
+            page[address & 0xff] = value;
+            mark_dirty(address);
+        } else {
+            set_unmapped(address, value);
+        }
+    }
+
+    /* Raw access to backing memory, bypassing any I/O handlers */
+    inline uint8_t peek(uint16_t address) const
+    {
+        return memory_[address];
+    }
+
+    /* Copy size bytes from address on, wrapping around past 0xffff as the
+     * address bus does
+     */
+    inline void peek(uint16_t address, uint8_t *data, size_t size) const
+    {
+        while (size) {
+            auto chunk = std::min(size, memory_.size() - address);
+            memcpy(data, &memory_[address], chunk);
+            data += chunk;
+            size -= chunk;
+            address = static_cast<uint16_t>(address + chunk);
+        }
+    }
+
+    inline void poke(uint16_t address, uint8_t value)
     {
         memory_[address] = value;
+        mark_dirty(address);
+    }
+
+    /* Pages written since the last call to clean() */
+    inline const page_set &dirty() const
+    {
+        return dirty_;
+    }
+
+    inline void clean()
+    {
+        dirty_.fill(0);
+    }
+
+    static inline bool contains(const page_set &pages, int page)
+    {
+        return pages[page / 64] >> (page % 64) & 1;
+    }
+
+    static inline page_set all_pages()
+    {
+        page_set pages;
+        pages.fill(~uint64_t{0});
+        return pages;
+    }
+
+    static int count(const page_set &pages);
+
+    inline unsigned long stable_until(uint16_t address, unsigned long clock) const
+    {
+        if (address < io_base)
+            return 0;
+
+        const auto &handler = io_[address & 0xff];
+        if (handler.stable_until)
+            return handler.stable_until(gb_, address, clock);
+        return handler.read ? 0 : ULONG_MAX;
     }
 
     inline uintptr_t get_native(uint16_t address)
     {
-        return native_[address].load();
+        return (*native_)[address].load();
     }
 
     void set_native(uint16_t address, uintptr_t func);
 
+    void set_io_handler(uint16_t address, IoHandler handler);
+
+    /* Page table control. ROM is mapped for reads only, and writes to it are
+     * dropped. While unmapped, every page except the one holding the I/O
+     * registers and HRAM reads as 0xff and ignores writes.
+     */
+    void map_all();
+    void unmap_all();
+
+    void copy(uint16_t dst, uint16_t src, size_t size);
+
     void load(std::istream &is);
 
+    /* Save or load the given pages. Compiled code is only dropped if the
+     * state holds different ROM contents, so restoring a state taken while
+     * running the same code doesn't force it to be compiled again. Since a
+     * block can run on into the next page and a trace can go anywhere in ROM,
+     * any change to ROM drops all of it. Returns whether ROM changed.
+     */
+    void save_state(StateWriter &state, const page_set &pages) const;
+    bool load_state(StateReader &state, const page_set &pages);
+
 private:
-    static constexpr int memory_size = 1 << 16;
+    static constexpr int io_page = io_base / page_size;
 
+    /* Pages below this hold ROM, the only memory code is compiled from */
+    static constexpr int rom_pages = 0x8000 / page_size;
+
+    using native_table = std::array<std::atomic_uintptr_t, memory_size>;
+
+    /* Accesses to pages missing from the page table. Only the I/O page is
+     * ever reachable while unmapped. Anything else is a bus conflict, or a
+     * write to ROM, which the MBC would take but this machine ignores. Kept
+     * out of line, so that wherever get and set are inlined, compiled code
+     * included, only the page table lookup is.
+     */
+    __attribute__((noinline))
+    uint8_t get_unmapped(uint16_t address) const
+    {
+        if (address >> 8 != io_page)
+            return 0xff;
+
+        const auto &handler = io_[address & 0xff];
+        if (handler.read)
+            return handler.read(gb_, address);
+        return memory_[address];
+    }
+
+    __attribute__((noinline))
+    void set_unmapped(uint16_t address, uint8_t value)
+    {
+        if (address >> 8 != io_page)
+            return;
+
+        const auto &handler = io_[address & 0xff];
+        if (handler.write)
+            handler.write(gb_, address, value);
+        else
+            poke(address, value);
+    }
+
+    inline void mark_dirty(uint16_t address)
+    {
+        dirty_[address >> 14] |= uint64_t{1} << (address >> 8 & 63);
+    }
+
+    GameboyImpl &gb_;
     std::array<uint8_t, memory_size> memory_;
-    std::array<std::atomic_uintptr_t, memory_size> native_;
+    std::array<uint8_t *, num_pages> map_;
+    std::array<uint8_t *, num_pages> write_map_;
+    page_set dirty_;
+    std::shared_ptr<native_table> native_;
+    std::array<IoHandler, 0x100> io_;
 };
 
 }
 
 #endif /* MMU_HPP_ */
-
@@ -33,6 +33,7 @@ void halt(GameboyImpl &gb)
 void ei(GameboyImpl &gb)
 {
     gb.cpu_.enable_interrupts();
+    gb.check_interrupts(1);
 }
 
 void di(GameboyImpl &gb)
@@ -76,7 +77,7 @@ void add_sub(GameboyImpl &gb, Dst dst, Src src)
     auto result = dst_value + src_value;
 
     gb.set(dst, static_cast<result_type>(result));
-    gb.set(ConditionCode::Z, result);
+    gb.set(ConditionCode::Z, static_cast<result_type>(result) == 0);
     gb.set(ConditionCode::N, sub);
     gb.set(ConditionCode::H, (result ^ dst_value ^ src_value) & half_carry_mask);
     gb.set(ConditionCode::C, result < dst_value);
@@ -174,7 +175,7 @@ void bitwise_op(GameboyImpl &gb, Op op)
 
     gb.set(ByteRegister::A, result);
     gb.set(ByteRegister::F, kind == BitwiseOperation::AND ? 0x20 : 0x00);
-    gb.set(ConditionCode::Z, result);
+    gb.set(ConditionCode::Z, result == 0);
 }
 
 template<typename Op>
@@ -412,6 +413,9 @@ void call(GameboyImpl &gb, Op op)
     if (gb.get(cc)) {
         gb.set(word_ptr<0, 2>(WordRegister::SP), gb.get(WordRegister::PC));
         gb.set(WordRegister::SP, gb.get(WordRegister::SP) - 2);
+#ifdef MJKGB_PROFILER
+        gb.profiler_.call(dest, gb.cpu_.get(WordRegister::SP));
+#endif
         gb.jump(dest, false);
     }
 }
@@ -428,11 +432,17 @@ void ret(GameboyImpl &gb)
     if (cc != ConditionCode::UNCONDITIONAL)
         gb.cpu_.tick();
 
-    if (enable_interrupts)
+    if (enable_interrupts) {
         gb.cpu_.enable_interrupts();
+        gb.check_interrupts();
+    }
 
-    if (gb.get(cc))
+    if (gb.get(cc)) {
+#ifdef MJKGB_PROFILER
+        gb.profiler_.ret(gb.cpu_.get(WordRegister::SP));
+#endif
         gb.jump(gb.get(word_ptr<2>(WordRegister::SP)));
+    }
 }
 
 void cb_prefix(GameboyImpl &);
@@ -448,6 +458,15 @@ void cb_prefix(GameboyImpl &);
  * syntactic/convenience reasons.
  */
 void GameboyImpl::run()
+{
+    reset();
+    run_until(Scheduler::never);
+}
+
+/* Leaving the loop is checked for only after events have been dispatched,
+ * so bounded runs cost nothing extra per instruction
+ */
+void GameboyImpl::run_until(unsigned long clock)
 {
     uint8_t opcode;
     static const void *dispatch_table[] = {
@@ -456,12 +475,17 @@ void GameboyImpl::run()
 #undef X
     };
 #define DISPATCH() do {                                     \
+    if (scheduler_.pending(cpu_.get_clock())) {             \
+        scheduler_.dispatch(*this, cpu_.get_clock());       \
+        if (yield_) return;                                 \
+    }                                                       \
     if (cpu_.is_stopped()) return;                          \
     opcode = get(ByteImmediate{});                          \
     goto *dispatch_table[opcode];                           \
 } while (false);
 
-    cpu_.reset();
+    yield_ = false;
+    scheduler_.schedule(Event::RUN_END, clock);
 
     DISPATCH();
     while (true) {
@@ -475,6 +499,30 @@ void GameboyImpl::run()
     }
 }
 
+void GameboyImpl::service_interrupts()
+{
+    auto pending = mmu_.peek(interrupt_flag_address) &
+        mmu_.peek(interrupt_enable_address) & 0x1f;
+    if (!pending || !cpu_.interrupt_flag())
+        return;
+
+    auto interrupt = 0;
+    while (!(pending & 1 << interrupt))
+        ++interrupt;
+
+    cpu_.disable_interrupts();
+    mmu_.poke(interrupt_flag_address,
+            mmu_.peek(interrupt_flag_address) & ~(1 << interrupt));
+
+    tick();
+    tick();
+    set(word_ptr<-2, -2>(WordRegister::SP), get(WordRegister::PC));
+#ifdef MJKGB_PROFILER
+    profiler_.call(static_cast<uint16_t>(0x40 + 8 * interrupt), cpu_.get(WordRegister::SP));
+#endif
+    jump(static_cast<uint16_t>(0x40 + 8 * interrupt));
+}
+
 namespace opcodes {
 namespace {
 
@@ -506,26 +554,79 @@ void cb_prefix(GameboyImpl &gb)
 namespace opcodes {
 namespace {
 
-void cb_prefix(GameboyImpl &gb)
-{
-    gb.tick();
-}
+/* The CB opcode's own function fetches the second byte */
+void cb_prefix(GameboyImpl &)
+{ }
 
 }
 }
 
+/* Compiled code is only entered by a jump and STOP ends a block, so unlike
+ * the dispatch loop the opcodes don't need to check for having stopped
+ */
 extern "C" {
 #define X(name, def, is_jump, cycles)                       \
 __attribute__((used))                                       \
 void name(GameboyImpl &gb)                                  \
 {                                                           \
-    if (gb.cpu_.is_stopped()) return;                       \
+    gb.fetch();                                             \
     def(gb);                                                \
-    gb.tick();                                              \
 }
 #include "opcode_map.in"
 #include "cb_opcode_map.in"
 #undef X
+
+/* Immediates at addresses the compiler can't work out are read as usual.
+ * Kept out of line until then, so that the reads are still there to find.
+ */
+__attribute__((used, noinline))
+uint8_t jit_immediate(GameboyImpl &gb, uint16_t address)
+{
+    return gb.mmu_.get(address);
+}
+
+/* Set PC to the address of the instruction about to run, which it already
+ * is, so that once inlined the optimizer knows where each immediate is
+ */
+__attribute__((used))
+void jit_at(GameboyImpl &gb, uint16_t address)
+{
+    gb.cpu_.set(WordRegister::PC, address, false);
+}
+
+/* Whether compiled code taking up to cycles can run without passing the
+ * next event. Otherwise it leaves without running anything, and the dispatch
+ * loop interprets up to the event, so events happen when they would have
+ * without compiled code.
+ */
+__attribute__((used))
+bool jit_budget(GameboyImpl &gb, uint32_t cycles)
+{
+    return gb.cpu_.get_clock() + cycles <= gb.scheduler_.next();
+}
+
+/* Count which way the branch before next went, from baseline code */
+__attribute__((used))
+void jit_profile(GameboyImpl &gb, uint16_t next, BranchCounts *counts)
+{
+    auto &count = gb.cpu_.get(WordRegister::PC) == next ? counts->not_taken : counts->taken;
+    count.fetch_add(1, std::memory_order_relaxed);
+}
+
+/* Whether a trace can carry on with the block at address taking up to
+ * cycles, rather than returning to the dispatch loop. Only if execution went
+ * that way and the block fits before the next event, in which case the block
+ * any jump chained to is dropped.
+ */
+__attribute__((used))
+bool jit_continue(GameboyImpl &gb, uint16_t address, uint32_t cycles)
+{
+    if (gb.cpu_.get(WordRegister::PC) != address || !jit_budget(gb, cycles))
+        return false;
+
+    gb.chained_ = 0;
+    return true;
+}
 }
 
 
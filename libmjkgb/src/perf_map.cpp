@@ -0,0 +1,282 @@
+#include <atomic>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+
+#include <elf.h>
+#include <fcntl.h>
+#include <link.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "perf_map.hpp"
+
+/* Weak, so that if LLVM's own registration for MCJIT is linked in, there is
+ * still only the one descriptor GDB looks for
+ */
+extern "C" {
+
+__attribute__((weak, noinline))
+void __jit_debug_register_code()
+{
+    /* Kept from being optimized away, since GDB breaks here */
+    __asm__ __volatile__("");
+}
+
+__attribute__((weak))
+jit_descriptor __jit_debug_descriptor = { 1, JIT_NOACTION, nullptr, nullptr };
+
+}
+
+namespace mjkgb {
+
+using namespace std;
+
+namespace {
+
+/* "JiTD" */
+constexpr uint32_t dump_magic = 0x4a695444;
+constexpr uint32_t dump_version = 1;
+constexpr uint32_t code_load_record = 0;
+
+/* Fixed parts of the file header and of a code load record */
+constexpr uint32_t header_size = 40;
+constexpr uint32_t code_load_size = 56;
+
+#if defined(__x86_64__)
+constexpr uint32_t elf_machine = EM_X86_64;
+#elif defined(__i386__)
+constexpr uint32_t elf_machine = EM_386;
+#elif defined(__aarch64__)
+constexpr uint32_t elf_machine = EM_AARCH64;
+#elif defined(__arm__)
+constexpr uint32_t elf_machine = EM_ARM;
+#else
+constexpr uint32_t elf_machine = EM_NONE;
+#endif
+
+mutex process_mutex;
+atomic<PerfMap *> process_map{nullptr};
+
+/* Guards GDB's list of entries */
+mutex gdb_mutex;
+
+/* Sections of the objects for GDB, and their names' offsets in shstrtab */
+enum Section {
+    NULL_SECTION,
+    TEXT,
+    SYMTAB,
+    STRTAB,
+    SHSTRTAB,
+    NUM_SECTIONS,
+};
+
+const char section_names[] = "\0.text\0.symtab\0.strtab\0.shstrtab";
+const ElfW(Word) section_name_offsets[NUM_SECTIONS] = { 0, 1, 7, 15, 23 };
+
+template<typename T>
+void append(vector<char> &data, const T &value)
+{
+    auto bytes = reinterpret_cast<const char *>(&value);
+    data.insert(data.end(), bytes, bytes + sizeof(T));
+}
+
+/* Fields are in the host's byte order, which perf tells from the magic */
+template<typename T>
+void write(ostream &os, T value)
+{
+    os.write(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+/* perf record lines events up with jitdump records by the monotonic clock */
+uint64_t timestamp()
+{
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<uint64_t>(now.tv_sec) * 1000000000 + static_cast<uint64_t>(now.tv_nsec);
+}
+
+}
+
+PerfMap::PerfMap(const string &map_path, const string &dump_path)
+  : mutex_(),
+    map_(map_path),
+    dump_(),
+    marker_(MAP_FAILED),
+    marker_size_(static_cast<size_t>(sysconf(_SC_PAGESIZE))),
+    index_(0)
+{
+    if (dump_path.empty())
+        return;
+
+    dump_.open(dump_path, ios::binary | ios::trunc);
+    write(dump_, dump_magic);
+    write(dump_, dump_version);
+    write(dump_, header_size);
+    write(dump_, elf_machine);
+    write(dump_, uint32_t{0});
+    write(dump_, static_cast<uint32_t>(getpid()));
+    write(dump_, timestamp());
+    write(dump_, uint64_t{0});
+    dump_.flush();
+
+    /* perf record only notices the dump through an executable mapping of it */
+    auto fd = open(dump_path.c_str(), O_RDONLY);
+    if (fd >= 0) {
+        marker_ = mmap(nullptr, marker_size_, PROT_READ | PROT_EXEC, MAP_PRIVATE, fd, 0);
+        close(fd);
+    }
+}
+
+PerfMap::~PerfMap()
+{
+    if (marker_ != MAP_FAILED)
+        munmap(marker_, marker_size_);
+}
+
+void PerfMap::add(uintptr_t code, size_t size, const string &name)
+{
+    lock_guard<mutex> lock{mutex_};
+
+    char line[40];
+    snprintf(line, sizeof(line), "%" PRIxPTR " %zx ", code, size);
+    map_ << line << name << '\n';
+    map_.flush();
+
+    if (!dump_.is_open())
+        return;
+
+    write(dump_, code_load_record);
+    write(dump_, static_cast<uint32_t>(code_load_size + name.size() + 1 + size));
+    write(dump_, timestamp());
+    write(dump_, static_cast<uint32_t>(getpid()));
+    write(dump_, static_cast<uint32_t>(syscall(SYS_gettid)));
+    write(dump_, static_cast<uint64_t>(code));
+    write(dump_, static_cast<uint64_t>(code));
+    write(dump_, static_cast<uint64_t>(size));
+    write(dump_, index_++);
+    dump_.write(name.c_str(), static_cast<streamsize>(name.size() + 1));
+    dump_.write(reinterpret_cast<const char *>(code), static_cast<streamsize>(size));
+    dump_.flush();
+}
+
+void PerfMap::enable(const string &dump_directory)
+{
+    lock_guard<mutex> lock{process_mutex};
+    if (process_map)
+        return;
+
+    auto pid = to_string(getpid());
+    auto dump_path = dump_directory.empty() ? "" : dump_directory + "/jit-" + pid + ".dump";
+
+    /* Never freed, as compilers may be adding to it at any time */
+    process_map = new PerfMap{"/tmp/perf-" + pid + ".map", dump_path};
+}
+
+PerfMap *PerfMap::get()
+{
+    return process_map.load(memory_order_acquire);
+}
+
+/* A relocatable object with an empty .text placed over the code, so that
+ * GDB takes the symbol's value as relative to the code
+ */
+GdbEntry::GdbEntry(uintptr_t code, size_t size, const string &name)
+  : symfile_(),
+    entry_()
+{
+    ElfW(Sym) symbols[2];
+    memset(symbols, 0, sizeof(symbols));
+    symbols[1].st_name = 1;
+    symbols[1].st_info = STB_GLOBAL << 4 | STT_FUNC;
+    symbols[1].st_shndx = TEXT;
+    symbols[1].st_size = size;
+
+    auto data_offset = sizeof(ElfW(Ehdr)) + NUM_SECTIONS * sizeof(ElfW(Shdr));
+    auto strtab_offset = data_offset + sizeof(symbols);
+    auto strtab_size = name.size() + 2;
+    auto shstrtab_offset = strtab_offset + strtab_size;
+
+    ElfW(Ehdr) header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.e_ident, ELFMAG, SELFMAG);
+    header.e_ident[EI_CLASS] = sizeof(void *) == 8 ? ELFCLASS64 : ELFCLASS32;
+    header.e_ident[EI_DATA] = __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__ ? ELFDATA2LSB : ELFDATA2MSB;
+    header.e_ident[EI_VERSION] = EV_CURRENT;
+    header.e_type = ET_REL;
+    header.e_machine = elf_machine;
+    header.e_version = EV_CURRENT;
+    header.e_shoff = sizeof(header);
+    header.e_ehsize = sizeof(header);
+    header.e_shentsize = sizeof(ElfW(Shdr));
+    header.e_shnum = NUM_SECTIONS;
+    header.e_shstrndx = SHSTRTAB;
+
+    ElfW(Shdr) sections[NUM_SECTIONS];
+    memset(sections, 0, sizeof(sections));
+    for (int i = 0; i < NUM_SECTIONS; ++i)
+        sections[i].sh_name = section_name_offsets[i];
+
+    sections[TEXT].sh_type = SHT_NOBITS;
+    sections[TEXT].sh_flags = SHF_ALLOC | SHF_EXECINSTR;
+    sections[TEXT].sh_addr = code;
+    sections[TEXT].sh_offset = data_offset;
+    sections[TEXT].sh_size = size;
+    sections[TEXT].sh_addralign = 1;
+
+    sections[SYMTAB].sh_type = SHT_SYMTAB;
+    sections[SYMTAB].sh_offset = data_offset;
+    sections[SYMTAB].sh_size = sizeof(symbols);
+    sections[SYMTAB].sh_link = STRTAB;
+    sections[SYMTAB].sh_info = 1;
+    sections[SYMTAB].sh_addralign = sizeof(void *);
+    sections[SYMTAB].sh_entsize = sizeof(ElfW(Sym));
+
+    sections[STRTAB].sh_type = SHT_STRTAB;
+    sections[STRTAB].sh_offset = strtab_offset;
+    sections[STRTAB].sh_size = strtab_size;
+    sections[STRTAB].sh_addralign = 1;
+
+    sections[SHSTRTAB].sh_type = SHT_STRTAB;
+    sections[SHSTRTAB].sh_offset = shstrtab_offset;
+    sections[SHSTRTAB].sh_size = sizeof(section_names);
+    sections[SHSTRTAB].sh_addralign = 1;
+
+    append(symfile_, header);
+    append(symfile_, sections);
+    append(symfile_, symbols);
+    symfile_.push_back('\0');
+    symfile_.insert(symfile_.end(), name.begin(), name.end());
+    symfile_.push_back('\0');
+    append(symfile_, section_names);
+
+    entry_.symfile_addr = symfile_.data();
+    entry_.symfile_size = symfile_.size();
+
+    lock_guard<mutex> lock{gdb_mutex};
+    entry_.next_entry = __jit_debug_descriptor.first_entry;
+    if (entry_.next_entry)
+        entry_.next_entry->prev_entry = &entry_;
+    __jit_debug_descriptor.first_entry = &entry_;
+    __jit_debug_descriptor.relevant_entry = &entry_;
+    __jit_debug_descriptor.action_flag = JIT_REGISTER_FN;
+    __jit_debug_register_code();
+}
+
+GdbEntry::~GdbEntry()
+{
+    lock_guard<mutex> lock{gdb_mutex};
+    if (entry_.prev_entry)
+        entry_.prev_entry->next_entry = entry_.next_entry;
+    else
+        __jit_debug_descriptor.first_entry = entry_.next_entry;
+    if (entry_.next_entry)
+        entry_.next_entry->prev_entry = entry_.prev_entry;
+    __jit_debug_descriptor.relevant_entry = &entry_;
+    __jit_debug_descriptor.action_flag = JIT_UNREGISTER_FN;
+    __jit_debug_register_code();
+}
+
+}
@@ -0,0 +1,104 @@
+#ifndef PERF_MAP_HPP_
+#define PERF_MAP_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/* GDB's JIT interface. GDB sets a breakpoint in __jit_debug_register_code,
+ * and on each call reads the in-memory object file of the entry which
+ * __jit_debug_descriptor says was added or removed.
+ */
+extern "C" {
+
+enum jit_actions_t {
+    JIT_NOACTION = 0,
+    JIT_REGISTER_FN,
+    JIT_UNREGISTER_FN,
+};
+
+struct jit_code_entry {
+    jit_code_entry *next_entry;
+    jit_code_entry *prev_entry;
+    const char *symfile_addr;
+    uint64_t symfile_size;
+};
+
+struct jit_descriptor {
+    uint32_t version;
+    uint32_t action_flag;
+    jit_code_entry *relevant_entry;
+    jit_code_entry *first_entry;
+};
+
+void __jit_debug_register_code();
+extern jit_descriptor __jit_debug_descriptor;
+
+}
+
+namespace mjkgb {
+
+/* Tells host profilers what compiled code is, which otherwise shows up as
+ * unknown addresses. perf reads symbols for such code from a map with a line
+ * of address, size and name per function. The jitdump format carries a copy
+ * of the code as well, which perf inject --jit turns into objects perf
+ * report can annotate once the process has gone.
+ */
+class PerfMap {
+public:
+    /* Writes the map to map_path, and a jitdump to dump_path unless empty */
+    PerfMap(const std::string &map_path, const std::string &dump_path);
+    ~PerfMap();
+
+    PerfMap(const PerfMap &) = delete;
+    PerfMap &operator=(const PerfMap &) = delete;
+
+    void add(uintptr_t code, size_t size, const std::string &name);
+
+    /* Start writing /tmp/perf-<pid>.map for the whole process, and
+     * jit-<pid>.dump into dump_directory unless empty. There's no stopping,
+     * as perf expects the map to cover every function compiled. Later calls
+     * do nothing.
+     */
+    static void enable(const std::string &dump_directory);
+
+    /* The process wide map, or null if not enabled */
+    static PerfMap *get();
+
+private:
+    std::mutex mutex_;
+    std::ofstream map_;
+    std::ofstream dump_;
+    void *marker_;
+    size_t marker_size_;
+    uint64_t index_;
+};
+
+/* Names a compiled function for GDB for as long as it exists, through an
+ * object file holding nothing but a symbol for it. There's no line or unwind
+ * information, but backtraces and disassembly show which block is running.
+ */
+class GdbEntry {
+public:
+    GdbEntry(uintptr_t code, size_t size, const std::string &name);
+    ~GdbEntry();
+
+    GdbEntry(const GdbEntry &) = delete;
+    GdbEntry &operator=(const GdbEntry &) = delete;
+
+    inline const std::vector<char> &symfile() const
+    {
+        return symfile_;
+    }
+
+private:
+    std::vector<char> symfile_;
+    jit_code_entry entry_;
+};
+
+}
+
+#endif /* PERF_MAP_HPP_ */
@@ -0,0 +1,55 @@
+#include <cstdio>
+
+#include "mmu.hpp"
+#include "profiler.hpp"
+
+namespace mjkgb {
+
+using namespace std;
+
+constexpr size_t Profiler::max_depth;
+
+void Profiler::start(unsigned long period, unsigned long clock)
+{
+    period_ = period;
+    restart(clock);
+    samples_.clear();
+}
+
+void Profiler::stop()
+{
+    period_ = 0;
+}
+
+void Profiler::sample(uint16_t pc)
+{
+    due_ += period_;
+
+    stack_.clear();
+    for (size_t i = 0; i < depth_; ++i)
+        stack_.push_back(frames_[i].target);
+    stack_.push_back(pc);
+
+    auto count = samples_.find(stack_);
+    if (count != samples_.end())
+        ++count->second;
+    else
+        samples_.emplace(stack_, 1);
+}
+
+string Profiler::collapsed() const
+{
+    string out;
+    for (const auto &sample : samples_) {
+        for (size_t i = 0; i < sample.first.size(); ++i) {
+            auto address = sample.first[i];
+            char frame[9];
+            snprintf(frame, sizeof(frame), "%s%02x:%04x", i ? ";" : "", Mmu::bank(address), address);
+            out += frame;
+        }
+        out += ' ' + to_string(sample.second) + '\n';
+    }
+    return out;
+}
+
+}
@@ -0,0 +1,116 @@
+#ifndef PROFILER_HPP_
+#define PROFILER_HPP_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace mjkgb {
+
+/* Sampling profiler for guest code. The machine takes a sample every period
+ * cycles as a scheduled event, recording PC under a shallow call stack which
+ * CALL, RST, RET and interrupts keep up to date, and counts how often each
+ * distinct stack was seen.
+ *
+ * Samples cost nothing per instruction, but keeping the stack adds to every
+ * call and return, so the machine is only hooked up to it when built with
+ * MJKGB_PROFILER.
+ */
+class Profiler {
+public:
+    /* Only the innermost calls are kept beyond this */
+    static constexpr size_t max_depth = 16;
+
+    Profiler()
+      : period_(0),
+        due_(0),
+        depth_(0),
+        frames_(),
+        stack_(),
+        samples_()
+    { }
+
+    /* Cycles between samples, 0 while stopped */
+    inline unsigned long period() const
+    {
+        return period_;
+    }
+
+    /* Clock at which the next sample is due. Each is due a period after the
+     * last was due rather than after it was taken, so that samples don't fall
+     * into step with a loop whose instructions overrun them.
+     */
+    inline unsigned long due() const
+    {
+        return due_;
+    }
+
+    /* Start afresh at clock, without any earlier samples */
+    void start(unsigned long period, unsigned long clock);
+    void stop();
+
+    /* Forget the call stack and sample a period from clock, as on reset or
+     * loading a state
+     */
+    inline void restart(unsigned long clock)
+    {
+        due_ = clock + period_;
+        depth_ = 0;
+    }
+
+    /* A call to target, leaving its return address at sp */
+    inline void call(uint16_t target, uint16_t sp)
+    {
+        if (depth_ == max_depth) {
+            for (size_t i = 1; i < max_depth; ++i)
+                frames_[i - 1] = frames_[i];
+            --depth_;
+        }
+        frames_[depth_++] = Frame{target, sp};
+    }
+
+    /* A return through the address at sp. Frames the guest abandoned by
+     * moving SP past them go with it.
+     */
+    inline void ret(uint16_t sp)
+    {
+        while (depth_ && frames_[depth_ - 1].sp <= sp)
+            --depth_;
+    }
+
+    /* Take the sample which is due, with the machine at pc */
+    void sample(uint16_t pc);
+
+    /* The samples in collapsed stack format, as read by flamegraph.pl and
+     * most other flame graph tools: a line for each distinct stack of its
+     * frames from the outermost, separated by semicolons, then the number of
+     * samples. Frames are the bank:address of the called code, and the last
+     * is where the sample was taken.
+     */
+    std::string collapsed() const;
+
+private:
+    struct Frame {
+        uint16_t target;
+        uint16_t sp;
+    };
+
+    unsigned long period_;
+    unsigned long due_;
+
+    size_t depth_;
+    std::array<Frame, max_depth> frames_;
+
+    /* Reused for each sample, so that samples of stacks already seen don't
+     * allocate
+     */
+    std::vector<uint16_t> stack_;
+    std::map<std::vector<uint16_t>, size_t> samples_;
+};
+
+}
+
+#endif /* PROFILER_HPP_ */
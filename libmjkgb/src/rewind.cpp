@@ -0,0 +1,217 @@
+#include <cstring>
+#include <utility>
+
+#include "gameboy_impl.hpp"
+#include "rewind.hpp"
+#include "state.hpp"
+
+namespace mjkgb {
+
+using namespace std;
+
+constexpr size_t Rewind::max_pending;
+
+namespace {
+
+inline void put_varint(vector<uint8_t> &out, size_t value)
+{
+    while (value >= 0x80) {
+        out.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+inline size_t get_varint(const vector<uint8_t> &in, size_t &offset)
+{
+    size_t value = 0;
+    for (auto shift = 0; ; shift += 7) {
+        auto byte = in[offset++];
+        value |= static_cast<size_t>(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+            return value;
+    }
+}
+
+}
+
+Rewind::Rewind(size_t budget)
+  : mutex_(),
+    wake_(),
+    done_(),
+    stop_(false),
+    busy_(false),
+    budget_(budget),
+    used_(0),
+    pending_(),
+    free_(),
+    newest_(),
+    deltas_(),
+    thread_(&Rewind::work, this)
+{ }
+
+Rewind::~Rewind()
+{
+    {
+        lock_guard<mutex> lock{mutex_};
+        stop_ = true;
+    }
+    wake_.notify_one();
+    thread_.join();
+}
+
+void Rewind::set_budget(size_t budget)
+{
+    lock_guard<mutex> lock{mutex_};
+    budget_ = budget;
+    trim();
+}
+
+void Rewind::capture(const GameboyImpl &gb)
+{
+    vector<uint8_t> state;
+    {
+        unique_lock<mutex> lock{mutex_};
+        done_.wait(lock, [this] { return pending_.size() < max_pending; });
+        if (!free_.empty()) {
+            state = move(free_.back());
+            free_.pop_back();
+        }
+    }
+
+    /* Captures have no generation, so a machine rewound to one has no parent
+     * for its next delta rather than one its memory no longer matches
+     */
+    state.resize(gb.state_size());
+    StateWriter writer{state.data(), state.size()};
+    gb.save_state(writer, Mmu::all_pages(), 0);
+
+    {
+        lock_guard<mutex> lock{mutex_};
+        pending_.push_back(move(state));
+    }
+    wake_.notify_one();
+}
+
+size_t Rewind::frames()
+{
+    unique_lock<mutex> lock{mutex_};
+    drain(lock);
+    return deltas_.size();
+}
+
+bool Rewind::rewind(GameboyImpl &gb, size_t frames)
+{
+    unique_lock<mutex> lock{mutex_};
+    drain(lock);
+    if (newest_.empty() || frames > deltas_.size())
+        return false;
+
+    for (size_t i = 0; i < frames; ++i) {
+        apply(deltas_.back(), newest_.data());
+        used_ -= deltas_.back().size();
+        deltas_.pop_back();
+    }
+
+    StateReader reader{newest_.data(), newest_.size()};
+    return gb.load_state(reader);
+}
+
+size_t Rewind::used()
+{
+    unique_lock<mutex> lock{mutex_};
+    drain(lock);
+    return used_;
+}
+
+/* Deltas are pairs of a count of unchanged bytes and a count of changed bytes
+ * followed by those bytes XORed together, with both counts as varints.
+ */
+void Rewind::encode(const uint8_t *from, const uint8_t *to, size_t size,
+        vector<uint8_t> &out)
+{
+    out.clear();
+
+    size_t i = 0;
+    while (i < size) {
+        auto start = i;
+        while (i + 8 <= size && !memcmp(from + i, to + i, 8))
+            i += 8;
+        while (i < size && from[i] == to[i])
+            ++i;
+        put_varint(out, i - start);
+
+        start = i;
+        while (i < size && from[i] != to[i])
+            ++i;
+        put_varint(out, i - start);
+        for (auto j = start; j < i; ++j)
+            out.push_back(from[j] ^ to[j]);
+    }
+}
+
+void Rewind::apply(const vector<uint8_t> &delta, uint8_t *state)
+{
+    size_t offset = 0;
+    for (size_t i = 0; i < delta.size(); ) {
+        offset += get_varint(delta, i);
+        auto count = get_varint(delta, i);
+        for (auto end = offset + count; offset < end; ++offset)
+            state[offset] ^= delta[i++];
+    }
+}
+
+void Rewind::work()
+{
+    vector<uint8_t> scratch;
+
+    unique_lock<mutex> lock{mutex_};
+    while (true) {
+        wake_.wait(lock, [this] { return stop_ || !pending_.empty(); });
+        if (stop_)
+            return;
+
+        auto state = move(pending_.front());
+        pending_.pop_front();
+        auto previous = move(newest_);
+        busy_ = true;
+        done_.notify_all();
+
+        lock.unlock();
+        auto chained = previous.size() == state.size();
+        if (chained)
+            encode(state.data(), previous.data(), state.size(), scratch);
+        lock.lock();
+
+        if (chained) {
+            deltas_.emplace_back(scratch.begin(), scratch.end());
+            used_ += scratch.size();
+        } else {
+            deltas_.clear();
+            used_ = state.size();
+        }
+
+        newest_ = move(state);
+        if (!previous.empty())
+            free_.push_back(move(previous));
+        trim();
+
+        busy_ = false;
+        done_.notify_all();
+    }
+}
+
+void Rewind::drain(unique_lock<mutex> &lock)
+{
+    done_.wait(lock, [this] { return pending_.empty() && !busy_; });
+}
+
+void Rewind::trim()
+{
+    while (used_ > budget_ && !deltas_.empty()) {
+        used_ -= deltas_.front().size();
+        deltas_.pop_front();
+    }
+}
+
+}
@@ -0,0 +1,86 @@
+#ifndef REWIND_HPP_
+#define REWIND_HPP_
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace mjkgb {
+
+struct GameboyImpl;
+
+/* History of past frames for stepping backwards. A full state is saved every
+ * frame on the emulator thread, which is little more than a copy of memory,
+ * and handed to a helper thread. That XORs it against the previous frame and
+ * run length encodes the result, which is mostly zeros.
+ *
+ * Only the newest state is kept whole. Stepping back applies deltas to it
+ * newest first, each costing time proportional to what changed in that frame.
+ * The oldest deltas are dropped to stay within the memory budget.
+ */
+class Rewind {
+public:
+    explicit Rewind(size_t budget);
+    ~Rewind();
+
+    Rewind(const Rewind &) = delete;
+    Rewind &operator=(const Rewind &) = delete;
+
+    void set_budget(size_t budget);
+
+    /* Called by the emulator thread at the start of each VBlank */
+    void capture(const GameboyImpl &gb);
+
+    /* Number of frames which can be stepped back */
+    size_t frames();
+
+    /* Restore the state from the given number of frames ago, discarding the
+     * history after it. Returns false if not enough history is available.
+     * The next delta saved holds every page.
+     */
+    bool rewind(GameboyImpl &gb, size_t frames);
+
+    /* Bytes used by the history, excluding states not yet encoded */
+    size_t used();
+
+    static void encode(const uint8_t *from, const uint8_t *to, size_t size,
+            std::vector<uint8_t> &out);
+    static void apply(const std::vector<uint8_t> &delta, uint8_t *state);
+
+private:
+    /* Captures waiting for the helper are limited so that a slow helper
+     * throttles the emulator rather than using unbounded memory
+     */
+    static constexpr size_t max_pending = 8;
+
+    void work();
+
+    /* Wait for the helper to encode every capture, with mutex_ held */
+    void drain(std::unique_lock<std::mutex> &lock);
+    void trim();
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+    bool stop_;
+    bool busy_;
+
+    size_t budget_;
+    size_t used_;
+
+    std::deque<std::vector<uint8_t>> pending_;
+    std::vector<std::vector<uint8_t>> free_;
+
+    std::vector<uint8_t> newest_;
+    std::deque<std::vector<uint8_t>> deltas_;
+
+    std::thread thread_;
+};
+
+}
+
+#endif /* REWIND_HPP_ */
@@ -0,0 +1,93 @@
+#ifndef RING_BUFFER_HPP_
+#define RING_BUFFER_HPP_
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+namespace mjkgb {
+
+/* Bounded lock free single producer, single consumer ring buffer. The
+ * emulator thread writes and any one other thread may read. When full, writes
+ * are truncated rather than overwriting data that hasn't been read yet.
+ *
+ * Storage is only allocated by the first write, so that machines which never
+ * produce any output, and copies of them, don't pay for it. Copies start out
+ * empty.
+ */
+template<typename T>
+class RingBuffer {
+public:
+    /* Capacity must be a power of two */
+    explicit RingBuffer(size_t capacity)
+      : head_(0),
+        buffer_(),
+        mask_(capacity - 1),
+        tail_(0)
+    { }
+
+    RingBuffer(const RingBuffer &other)
+      : RingBuffer(other.capacity())
+    { }
+
+    RingBuffer &operator=(const RingBuffer &) = delete;
+
+    inline size_t size() const
+    {
+        return head_.load(std::memory_order_acquire) -
+            tail_.load(std::memory_order_acquire);
+    }
+
+    inline size_t capacity() const
+    {
+        return mask_ + 1;
+    }
+
+    size_t write(const T *data, size_t count)
+    {
+        auto head = head_.load(std::memory_order_relaxed);
+        auto tail = tail_.load(std::memory_order_acquire);
+        count = std::min(count, capacity() - (head - tail));
+
+        /* Published to the reader by the release store of head_ below */
+        if (buffer_.empty())
+            buffer_.resize(capacity());
+
+        for (size_t i = 0; i < count; ++i)
+            buffer_[(head + i) & mask_] = data[i];
+
+        head_.store(head + count, std::memory_order_release);
+        return count;
+    }
+
+    size_t read(T *data, size_t count)
+    {
+        auto tail = tail_.load(std::memory_order_relaxed);
+        auto head = head_.load(std::memory_order_acquire);
+        count = std::min(count, head - tail);
+
+        for (size_t i = 0; i < count; ++i)
+            data[i] = buffer_[(tail + i) & mask_];
+
+        tail_.store(tail + count, std::memory_order_release);
+        return count;
+    }
+
+    /* Only safe to call from the consumer, or when neither side is active */
+    void clear()
+    {
+        tail_.store(head_.load(std::memory_order_acquire), std::memory_order_release);
+    }
+
+private:
+    /* Keep the indices written by each side apart */
+    std::atomic<size_t> head_;
+    std::vector<T> buffer_;
+    size_t mask_;
+    std::atomic<size_t> tail_;
+};
+
+}
+
+#endif /* RING_BUFFER_HPP_ */
@@ -0,0 +1,14 @@
+#include "scheduler.hpp"
+
+namespace mjkgb {
+
+using namespace std;
+
+constexpr unsigned long Scheduler::never;
+
+void Scheduler::set_handler(Event event, handler func)
+{
+    handlers_[static_cast<size_t>(event)] = func;
+}
+
+}
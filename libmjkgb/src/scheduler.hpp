@@ -0,0 +1,127 @@
+#ifndef SCHEDULER_HPP_
+#define SCHEDULER_HPP_
+
+#include <array>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+
+#include "state.hpp"
+
+namespace mjkgb {
+
+struct GameboyImpl;
+
+/* Events after RUN_END belong to the host rather than the machine, and
+ * aren't saved
+ */
+enum class Event {
+    INTERRUPT, TIMER_OVERFLOW, DMA_END, APU_UPDATE, VBLANK, INPUT, RUN_END,
+#ifdef MJKGB_PROFILER
+    PROFILE_SAMPLE,
+#endif
+    NUM_EVENTS
+};
+
+/* Keeps a deadline for each kind of future event. Peripherals compute when
+ * their next externally visible change happens and schedule it here, so the
+ * only per instruction cost is comparing the clock against next().
+ */
+class Scheduler {
+public:
+    using handler = void (*)(GameboyImpl &);
+
+    static constexpr unsigned long never = ULONG_MAX;
+
+    Scheduler()
+      : next_(never),
+        deadlines_(),
+        handlers_()
+    {
+        reset();
+    }
+
+    inline unsigned long next() const
+    {
+        return next_;
+    }
+
+    inline bool pending(unsigned long clock) const
+    {
+        return clock >= next_;
+    }
+
+    inline void schedule(Event event, unsigned long clock)
+    {
+        deadlines_[static_cast<size_t>(event)] = clock;
+        update();
+    }
+
+    inline void cancel(Event event)
+    {
+        schedule(event, never);
+    }
+
+    inline unsigned long deadline(Event event) const
+    {
+        return deadlines_[static_cast<size_t>(event)];
+    }
+
+    /* Fire all events due at or before clock, earliest first */
+    inline void dispatch(GameboyImpl &gb, unsigned long clock)
+    {
+        while (clock >= next_) {
+            size_t index = 0;
+            for (size_t i = 1; i < num_events; ++i)
+                if (deadlines_[i] < deadlines_[index])
+                    index = i;
+
+            deadlines_[index] = never;
+            update();
+            if (handlers_[index])
+                handlers_[index](gb);
+        }
+    }
+
+    inline void reset()
+    {
+        for (auto &deadline : deadlines_)
+            deadline = never;
+        next_ = never;
+    }
+
+    void set_handler(Event event, handler func);
+
+    inline void save_state(StateWriter &state) const
+    {
+        for (size_t i = 0; i < num_saved_events; ++i)
+            state.put<uint64_t>(deadlines_[i]);
+    }
+
+    inline void load_state(StateReader &state)
+    {
+        for (size_t i = 0; i < num_saved_events; ++i)
+            deadlines_[i] = static_cast<unsigned long>(state.get<uint64_t>());
+        update();
+    }
+
+private:
+    static constexpr size_t num_events = static_cast<size_t>(Event::NUM_EVENTS);
+    static constexpr size_t num_saved_events = static_cast<size_t>(Event::RUN_END) + 1;
+
+    inline void update()
+    {
+        next_ = never;
+        for (auto deadline : deadlines_)
+            if (deadline < next_)
+                next_ = deadline;
+    }
+
+    unsigned long next_;
+    std::array<unsigned long, num_events> deadlines_;
+    std::array<handler, num_events> handlers_;
+};
+
+}
+
+#endif /* SCHEDULER_HPP_ */
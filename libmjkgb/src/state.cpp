@@ -0,0 +1,163 @@
+#include <atomic>
+#include <random>
+#include <vector>
+
+#include "gameboy_impl.hpp"
+#include "state.hpp"
+
+namespace mjkgb {
+
+using namespace std;
+
+namespace {
+
+/* "MJKS" */
+constexpr uint32_t state_magic = 0x534b4a4d;
+
+/* Bump whenever any component changes what it saves */
+constexpr uint16_t state_version = 6;
+
+/* Generations count up from a random start, so that states saved by other
+ * processes are as unlikely to share one as states saved by this one
+ */
+uint64_t next_generation()
+{
+    static atomic<uint64_t> generations{[] {
+        random_device random;
+        return static_cast<uint64_t>(random()) << 32 | random();
+    }()};
+
+    uint64_t generation;
+    do
+        generation = generations++;
+    while (!generation);
+    return generation;
+}
+
+}
+
+size_t GameboyImpl::state_size() const
+{
+    StateWriter state{nullptr, 0};
+    save_state(state, Mmu::all_pages());
+    return state.size();
+}
+
+/* A state is a header with its generation, its parent's generation and the
+ * set of pages it holds, then all of the CPU and peripheral state, then the
+ * contents of those pages. Full states hold every page and have no parent.
+ * Deltas only hold the pages written since their parent was saved or loaded,
+ * so they are only loaded by a machine still exactly at their parent: one
+ * whose last state saved or loaded was the parent, and which hasn't written
+ * to memory since.
+ *
+ * States with generation 0, as kept for rewinding, can't be parents.
+ */
+void GameboyImpl::save_state(StateWriter &state, const Mmu::page_set &pages,
+        uint64_t generation, uint64_t parent) const
+{
+    state.put(state_magic);
+    state.put(state_version);
+    state.put(generation);
+    state.put(parent);
+    for (auto word : pages)
+        state.put(word);
+
+    save_machine(state);
+    mmu_.save_state(state, pages);
+}
+
+bool GameboyImpl::load_state(StateReader &state)
+{
+    uint64_t generation, parent;
+    Mmu::page_set pages;
+    if (state.remaining() < sizeof(state_magic) + sizeof(state_version) +
+                sizeof(generation) + sizeof(parent) + sizeof(pages) ||
+            state.get<uint32_t>() != state_magic ||
+            state.get<uint16_t>() != state_version)
+        return false;
+    state.get(generation);
+    state.get(parent);
+    for (auto &word : pages)
+        state.get(word);
+
+    /* Check the size once here so that nothing below can read past the end */
+    StateWriter machine{nullptr, 0};
+    save_machine(machine);
+    if (state.remaining() != machine.size() + static_cast<size_t>(Mmu::count(pages)) * Mmu::page_size)
+        return false;
+
+    /* Pages the delta leaves out would otherwise be kept from whatever this
+     * machine holds instead of its parent
+     */
+    if (parent && (parent != generation_ || Mmu::count(mmu_.dirty())))
+        return false;
+
+    load_machine(state);
+    if (mmu_.load_state(state, pages))
+        attach_code();
+    mmu_.clean();
+    generation_ = generation;
+
+    return true;
+}
+
+size_t GameboyImpl::save_snapshot(uint8_t *buffer, size_t size, bool delta)
+{
+    auto parent = delta ? generation_ : 0;
+    auto generation = next_generation();
+
+    StateWriter state{buffer, size};
+    save_state(state, parent ? mmu_.dirty() : Mmu::all_pages(), generation, parent);
+    if (state.overflowed())
+        return 0;
+
+    mmu_.clean();
+    generation_ = generation;
+    return state.size();
+}
+
+/* FNV-1a over a full state with no generation */
+uint64_t GameboyImpl::state_hash() const
+{
+    vector<uint8_t> buffer(state_size());
+    StateWriter state{buffer.data(), buffer.size()};
+    save_state(state, Mmu::all_pages());
+
+    uint64_t hash = 0xcbf29ce484222325;
+    for (auto byte : buffer) {
+        hash ^= byte;
+        hash *= 0x100000001b3;
+    }
+    return hash;
+}
+
+void GameboyImpl::save_machine(StateWriter &state) const
+{
+    cpu_.save_state(state);
+    scheduler_.save_state(state);
+    timer_.save_state(state);
+    dma_.save_state(state);
+    joypad_.save_state(state);
+    apu_.save_state(state);
+}
+
+void GameboyImpl::load_machine(StateReader &state)
+{
+    cpu_.load_state(state);
+    scheduler_.load_state(state);
+    timer_.load_state(state);
+    dma_.load_state(state, mmu_);
+    joypad_.load_state(state, scheduler_);
+    apu_.load_state(state);
+
+    /* Loop detection is keyed on addresses, which may now hold other code */
+    idle_.reset();
+
+#ifdef MJKGB_PROFILER
+    profiler_.restart(cpu_.get_clock());
+    schedule_sample();
+#endif
+}
+
+}
@@ -0,0 +1,116 @@
+#ifndef STATE_HPP_
+#define STATE_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+namespace mjkgb {
+
+/* Save state serialization. Each component writes its fields in a fixed order
+ * with no tags or padding, integers in little endian order, and the format as
+ * a whole carries a single version number. The same functions are used with a
+ * null buffer to measure the size of a state.
+ */
+class StateWriter {
+public:
+    StateWriter(uint8_t *buffer, size_t capacity)
+      : buffer_(buffer),
+        capacity_(capacity),
+        size_(0)
+    { }
+
+    template<typename T>
+    inline void put(T value)
+    {
+        static_assert(std::is_integral<T>::value, "only integers are serialized");
+
+        auto bits = static_cast<uint64_t>(value);
+        if (fits(sizeof(T)))
+            for (size_t i = 0; i < sizeof(T); ++i)
+                buffer_[size_ + i] = static_cast<uint8_t>(bits >> (8 * i));
+        size_ += sizeof(T);
+    }
+
+    inline void put(const uint8_t *data, size_t size)
+    {
+        if (fits(size))
+            memcpy(buffer_ + size_, data, size);
+        size_ += size;
+    }
+
+    /* Number of bytes written, or that would have been written */
+    inline size_t size() const
+    {
+        return size_;
+    }
+
+    inline bool overflowed() const
+    {
+        return size_ > capacity_;
+    }
+
+private:
+    inline bool fits(size_t size) const
+    {
+        return buffer_ && size_ + size <= capacity_;
+    }
+
+    uint8_t *buffer_;
+    size_t capacity_;
+    size_t size_;
+};
+
+/* Reads back what StateWriter wrote. The caller checks the total size up
+ * front, so components can read their fields unconditionally.
+ */
+class StateReader {
+public:
+    StateReader(const uint8_t *data, size_t size)
+      : data_(data),
+        size_(size),
+        offset_(0)
+    { }
+
+    template<typename T>
+    inline T get()
+    {
+        static_assert(std::is_integral<T>::value, "only integers are serialized");
+
+        uint64_t bits = 0;
+        if (offset_ + sizeof(T) <= size_)
+            for (size_t i = 0; i < sizeof(T); ++i)
+                bits |= static_cast<uint64_t>(data_[offset_ + i]) << (8 * i);
+        offset_ += sizeof(T);
+        return static_cast<T>(bits);
+    }
+
+    template<typename T>
+    inline void get(T &value)
+    {
+        value = get<T>();
+    }
+
+    /* Borrow the next size bytes directly from the underlying buffer */
+    inline const uint8_t *bytes(size_t size)
+    {
+        auto data = offset_ + size <= size_ ? data_ + offset_ : nullptr;
+        offset_ += size;
+        return data;
+    }
+
+    inline size_t remaining() const
+    {
+        return offset_ <= size_ ? size_ - offset_ : 0;
+    }
+
+private:
+    const uint8_t *data_;
+    size_t size_;
+    size_t offset_;
+};
+
+}
+
+#endif /* STATE_HPP_ */
@@ -0,0 +1,153 @@
+#include <algorithm>
+#include <cmath>
+
+#if defined(__AVX__) || defined(__SSE__)
+#include <immintrin.h>
+#endif
+
+#include "synth.hpp"
+
+namespace mjkgb {
+
+using namespace std;
+
+constexpr int Synth::kernel_width;
+constexpr int Synth::phase_bits;
+constexpr int Synth::num_phases;
+constexpr int Synth::frac_bits;
+
+namespace {
+
+/* Pass band edge as a fraction of the output Nyquist frequency */
+constexpr double cutoff = 0.9;
+
+/* Pole of the DC blocking filter, standing in for the capacitor on the real
+ * hardware's output.
+ */
+constexpr double dc_pole = 0.999;
+
+inline int16_t clamp_sample(double value)
+{
+    return static_cast<int16_t>(max(-32768.0, min(32767.0, value)));
+}
+
+}
+
+Synth::Synth(unsigned long input_rate, unsigned output_rate, size_t capacity)
+  : input_rate_(input_rate),
+    output_rate_(0),
+    factor_(0),
+    offset_(0),
+    frame_time_(0),
+    left_(0),
+    right_(0),
+    left_dc_(0),
+    right_dc_(0),
+    left_buffer_(capacity + kernel_width),
+    right_buffer_(capacity + kernel_width)
+{
+    set_rate(output_rate);
+}
+
+void Synth::set_rate(unsigned output_rate)
+{
+    output_rate_ = output_rate;
+    factor_ = (static_cast<uint64_t>(output_rate) << frac_bits) / input_rate_;
+}
+
+const Synth::kernel_table &Synth::kernels()
+{
+    static const kernel_table table = [] {
+        const auto pi = acos(-1.0);
+        kernel_table kernels;
+
+        for (int phase = 0; phase < num_phases; ++phase) {
+            double sum = 0;
+            array<double, kernel_width> taps;
+
+            for (int k = 0; k < kernel_width; ++k) {
+                /* Distance from the step in output samples */
+                auto x = k - kernel_width / 2 + 1 - static_cast<double>(phase) / num_phases;
+                auto sinc = x == 0 ? 1.0 : sin(pi * cutoff * x) / (pi * cutoff * x);
+                auto w = (x + kernel_width / 2) / kernel_width;
+                auto blackman = 0.42 - 0.5 * cos(2 * pi * w) + 0.08 * cos(4 * pi * w);
+                taps[k] = sinc * blackman;
+                sum += taps[k];
+            }
+
+            for (int k = 0; k < kernel_width; ++k)
+                kernels[phase][k] = static_cast<float>(taps[k] / sum);
+        }
+
+        return kernels;
+    }();
+
+    return table;
+}
+
+void Synth::add_impulse(float *out, const float *kernel, float delta)
+{
+#if defined(__AVX__)
+    auto d = _mm256_set1_ps(delta);
+    for (int k = 0; k < kernel_width; k += 8) {
+        auto o = _mm256_loadu_ps(out + k);
+        o = _mm256_add_ps(o, _mm256_mul_ps(_mm256_loadu_ps(kernel + k), d));
+        _mm256_storeu_ps(out + k, o);
+    }
+#elif defined(__SSE__)
+    auto d = _mm_set1_ps(delta);
+    for (int k = 0; k < kernel_width; k += 4) {
+        auto o = _mm_loadu_ps(out + k);
+        o = _mm_add_ps(o, _mm_mul_ps(_mm_loadu_ps(kernel + k), d));
+        _mm_storeu_ps(out + k, o);
+    }
+#else
+    for (int k = 0; k < kernel_width; ++k)
+        out[k] += kernel[k] * delta;
+#endif
+}
+
+size_t Synth::end_frame(unsigned long time, RingBuffer<int16_t> &out)
+{
+    auto count = pending(time);
+    int16_t samples[512];
+
+    for (size_t done = 0; done < count; ) {
+        auto batch = min(count - done, sizeof(samples) / sizeof(samples[0]) / 2);
+        for (size_t i = 0; i < batch; ++i) {
+            left_ += left_buffer_[done + i];
+            right_ += right_buffer_[done + i];
+            left_dc_ = dc_pole * left_dc_ + (1 - dc_pole) * left_;
+            right_dc_ = dc_pole * right_dc_ + (1 - dc_pole) * right_;
+            samples[2 * i] = clamp_sample(left_ - left_dc_);
+            samples[2 * i + 1] = clamp_sample(right_ - right_dc_);
+        }
+        out.write(samples, 2 * batch);
+        done += batch;
+    }
+
+    /* Impulses extend up to kernel_width samples past the current one */
+    for (auto buffer : { &left_buffer_, &right_buffer_ }) {
+        if (!count)
+            break;
+        copy(buffer->begin() + count, buffer->begin() + count + kernel_width, buffer->begin());
+        fill(buffer->begin() + kernel_width, buffer->begin() + count + kernel_width, 0.0f);
+    }
+
+    offset_ = offset_ + (time - frame_time_) * factor_ - (static_cast<uint64_t>(count) << frac_bits);
+    frame_time_ = time;
+
+    return count;
+}
+
+void Synth::reset(unsigned long time)
+{
+    offset_ = 0;
+    frame_time_ = time;
+    left_ = right_ = 0;
+    left_dc_ = right_dc_ = 0;
+    fill(left_buffer_.begin(), left_buffer_.end(), 0.0f);
+    fill(right_buffer_.begin(), right_buffer_.end(), 0.0f);
+}
+
+}
@@ -0,0 +1,93 @@
+#ifndef SYNTH_HPP_
+#define SYNTH_HPP_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "ring_buffer.hpp"
+
+namespace mjkgb {
+
+/* Band-limited step synthesis. Amplitude changes, timestamped in input clock
+ * cycles, are added to the output as windowed sinc impulses positioned with
+ * sub-sample precision. The running sum of the output is then a band-limited
+ * version of the original step waveform at the output rate, without ever
+ * rendering anything at the input rate.
+ */
+class Synth {
+public:
+    /* Width of each impulse in output samples, and number of sub-sample
+     * positions it is tabulated at.
+     */
+    static constexpr int kernel_width = 16;
+    static constexpr int phase_bits = 5;
+    static constexpr int num_phases = 1 << phase_bits;
+
+    Synth(unsigned long input_rate, unsigned output_rate, size_t capacity);
+
+    void set_rate(unsigned output_rate);
+
+    inline unsigned rate() const
+    {
+        return output_rate_;
+    }
+
+    inline void add_delta(unsigned long time, int left, int right)
+    {
+        auto position = offset_ + (time - frame_time_) * factor_;
+        auto index = static_cast<size_t>(position >> frac_bits);
+        auto phase = static_cast<size_t>(position >> (frac_bits - phase_bits)) & (num_phases - 1);
+
+        add_impulse(&left_buffer_[index], kernels()[phase].data(), static_cast<float>(left));
+        add_impulse(&right_buffer_[index], kernels()[phase].data(), static_cast<float>(right));
+    }
+
+    /* Number of whole samples between the last end_frame and time */
+    inline size_t pending(unsigned long time) const
+    {
+        return static_cast<size_t>((offset_ + (time - frame_time_) * factor_) >> frac_bits);
+    }
+
+    inline size_t capacity() const
+    {
+        return left_buffer_.size() - kernel_width;
+    }
+
+    /* Write out all samples which are complete at time */
+    size_t end_frame(unsigned long time, RingBuffer<int16_t> &out);
+
+    void reset(unsigned long time);
+
+private:
+    static constexpr int frac_bits = 32;
+
+    using kernel_table = std::array<std::array<float, kernel_width>, num_phases>;
+
+    static const kernel_table &kernels();
+
+    static void add_impulse(float *out, const float *kernel, float delta);
+
+    unsigned long input_rate_;
+    unsigned output_rate_;
+
+    /* Output samples per input cycle, in 32.32 fixed point */
+    uint64_t factor_;
+
+    /* Position of frame_time_ in the buffer, in 32.32 fixed point */
+    uint64_t offset_;
+    unsigned long frame_time_;
+
+    double left_;
+    double right_;
+    double left_dc_;
+    double right_dc_;
+
+    std::vector<float> left_buffer_;
+    std::vector<float> right_buffer_;
+};
+
+}
+
+#endif /* SYNTH_HPP_ */
@@ -0,0 +1,114 @@
+#include "thread_pool.hpp"
+
+namespace mjkgb {
+
+using namespace std;
+
+ThreadPool::ThreadPool(unsigned threads)
+  : queues_(),
+    mutex_(),
+    wake_(),
+    done_(),
+    func_(nullptr),
+    round_(0),
+    stop_(false),
+    remaining_(0),
+    threads_()
+{
+    if (!threads)
+        threads = max(1u, thread::hardware_concurrency());
+
+    for (unsigned i = 0; i < threads; ++i)
+        queues_.emplace_back(new Queue);
+    for (unsigned i = 0; i < threads; ++i)
+        threads_.emplace_back(&ThreadPool::work, this, i);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        lock_guard<mutex> lock{mutex_};
+        stop_ = true;
+    }
+    wake_.notify_all();
+    for (auto &thread : threads_)
+        thread.join();
+}
+
+void ThreadPool::run(size_t count, const task &func)
+{
+    if (!count)
+        return;
+
+    unique_lock<mutex> lock{mutex_};
+
+    /* Set before any task can be taken, and only changed again once they
+     * have all finished, so workers can read it without holding mutex_
+     */
+    func_ = &func;
+    remaining_ = count;
+    for (size_t index = 0; index < count; ++index) {
+        auto &queue = *queues_[index % queues_.size()];
+        lock_guard<std::mutex> queue_lock{queue.mutex};
+        queue.tasks.push_back(index);
+    }
+
+    ++round_;
+    wake_.notify_all();
+
+    done_.wait(lock, [this] { return remaining_ == 0; });
+    func_ = nullptr;
+}
+
+void ThreadPool::work(size_t id)
+{
+    uint64_t round = 0;
+
+    unique_lock<mutex> lock{mutex_};
+    while (true) {
+        wake_.wait(lock, [&] { return stop_ || round_ != round; });
+        if (stop_)
+            return;
+
+        round = round_;
+        lock.unlock();
+
+        size_t index;
+        while (take(id, index)) {
+            (*func_)(index);
+            if (--remaining_ == 0) {
+                lock_guard<mutex> done_lock{mutex_};
+                done_.notify_all();
+            }
+        }
+
+        lock.lock();
+    }
+}
+
+bool ThreadPool::take(size_t id, size_t &index)
+{
+    {
+        auto &own = *queues_[id];
+        lock_guard<mutex> lock{own.mutex};
+        if (!own.tasks.empty()) {
+            index = own.tasks.front();
+            own.tasks.pop_front();
+            return true;
+        }
+    }
+
+    for (size_t i = 1; i < queues_.size(); ++i) {
+        auto &victim = *queues_[(id + i) % queues_.size()];
+        lock_guard<mutex> lock{victim.mutex};
+        if (!victim.tasks.empty()) {
+            index = victim.tasks.back();
+            victim.tasks.pop_back();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+}
@@ -0,0 +1,65 @@
+#ifndef THREAD_POOL_HPP_
+#define THREAD_POOL_HPP_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace mjkgb {
+
+/* Work stealing pool for running a batch of independent tasks to completion.
+ * Tasks are dealt out evenly to per thread queues up front. Threads take from
+ * the front of their own queue, and once it is empty steal from the back of
+ * the others', so uneven task lengths don't leave threads idle.
+ */
+class ThreadPool {
+public:
+    using task = std::function<void(size_t)>;
+
+    /* Zero threads means one per core */
+    explicit ThreadPool(unsigned threads = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    inline size_t size() const
+    {
+        return threads_.size();
+    }
+
+    /* Run func for each index in [0, count), returning once all have finished */
+    void run(size_t count, const task &func);
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<size_t> tasks;
+    };
+
+    void work(size_t id);
+    bool take(size_t id, size_t &index);
+
+    std::vector<std::unique_ptr<Queue>> queues_;
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+    const task *func_;
+    uint64_t round_;
+    bool stop_;
+    std::atomic<size_t> remaining_;
+
+    std::vector<std::thread> threads_;
+};
+
+}
+
+#endif /* THREAD_POOL_HPP_ */
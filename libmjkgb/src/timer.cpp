@@ -0,0 +1,153 @@
+#include "gameboy_impl.hpp"
+#include "mmu.hpp"
+#include "scheduler.hpp"
+#include "state.hpp"
+#include "timer.hpp"
+
+namespace mjkgb {
+
+using namespace std;
+
+constexpr uint16_t Timer::div_address;
+constexpr uint16_t Timer::tima_address;
+constexpr uint16_t Timer::tma_address;
+constexpr uint16_t Timer::tac_address;
+constexpr unsigned long Timer::never;
+
+namespace {
+
+uint8_t read_timer(GameboyImpl &gb, uint16_t address)
+{
+    auto clock = gb.cpu_.get_clock();
+
+    switch (address) {
+    case Timer::div_address:
+        return gb.timer_.div(clock);
+    case Timer::tima_address:
+        gb.timer_.update(gb, clock);
+        return gb.timer_.tima(clock);
+    case Timer::tma_address:
+        return gb.timer_.tma();
+    default:
+        return gb.timer_.tac();
+    }
+}
+
+void write_timer(GameboyImpl &gb, uint16_t address, uint8_t value)
+{
+    auto clock = gb.cpu_.get_clock();
+
+    switch (address) {
+    case Timer::div_address:
+        gb.timer_.set_div(gb, clock);
+        break;
+    case Timer::tima_address:
+        gb.timer_.set_tima(gb, value, clock);
+        break;
+    case Timer::tma_address:
+        gb.timer_.set_tma(value);
+        break;
+    default:
+        gb.timer_.set_tac(gb, value, clock);
+        break;
+    }
+}
+
+unsigned long timer_stable_until(GameboyImpl &gb, uint16_t address, unsigned long clock)
+{
+    switch (address) {
+    case Timer::div_address:
+        return gb.timer_.next_div(clock);
+    case Timer::tima_address:
+        return gb.timer_.next_increment(clock);
+    default:
+        return Timer::never;
+    }
+}
+
+void timer_overflow(GameboyImpl &gb)
+{
+    gb.timer_.update(gb, gb.cpu_.get_clock());
+}
+
+}
+
+void Timer::update(GameboyImpl &gb, unsigned long clock)
+{
+    auto overflowed = false;
+    for (auto at = overflow_clock(); at <= clock; at = overflow_clock()) {
+        tima_ = tma_;
+        tima_clock_ = at;
+        overflowed = true;
+        gb.request_interrupt(Interrupt::TIMER);
+    }
+
+    tima_ = tima(clock);
+    tima_clock_ = clock;
+
+    if (overflowed)
+        reschedule(gb);
+}
+
+void Timer::set_div(GameboyImpl &gb, unsigned long clock)
+{
+    update(gb, clock);
+    div_base_ = clock;
+    reschedule(gb);
+}
+
+void Timer::set_tima(GameboyImpl &gb, uint8_t value, unsigned long clock)
+{
+    update(gb, clock);
+    tima_ = value;
+    reschedule(gb);
+}
+
+void Timer::set_tma(uint8_t value)
+{
+    tma_ = value;
+}
+
+void Timer::set_tac(GameboyImpl &gb, uint8_t value, unsigned long clock)
+{
+    update(gb, clock);
+    tac_ = value & 0x07;
+    reschedule(gb);
+}
+
+void Timer::reset()
+{
+    *this = Timer{};
+}
+
+void Timer::save_state(StateWriter &state) const
+{
+    state.put<uint64_t>(div_base_);
+    state.put<uint64_t>(tima_clock_);
+    state.put(tima_);
+    state.put(tma_);
+    state.put(tac_);
+}
+
+void Timer::load_state(StateReader &state)
+{
+    div_base_ = static_cast<unsigned long>(state.get<uint64_t>());
+    tima_clock_ = static_cast<unsigned long>(state.get<uint64_t>());
+    state.get(tima_);
+    state.get(tma_);
+    state.get(tac_);
+}
+
+void Timer::reschedule(GameboyImpl &gb)
+{
+    gb.scheduler_.schedule(Event::TIMER_OVERFLOW, overflow_clock());
+}
+
+void Timer::attach(Mmu &mmu, Scheduler &scheduler)
+{
+    for (uint16_t address = div_address; address <= tac_address; ++address)
+        mmu.set_io_handler(address, { read_timer, write_timer, timer_stable_until });
+    scheduler.set_handler(Event::TIMER_OVERFLOW, timer_overflow);
+}
+
+}
@@ -0,0 +1,128 @@
+#ifndef TIMER_HPP_
+#define TIMER_HPP_
+
+#include <climits>
+#include <cstdint>
+
+namespace mjkgb {
+
+struct GameboyImpl;
+class Mmu;
+class Scheduler;
+class StateReader;
+class StateWriter;
+
+/* DIV and TIMA are never ticked. DIV is derived from the clock and the point
+ * it was last reset, TIMA from the value and clock it was last synced at. The
+ * only thing that is scheduled is the next TIMA overflow, which is recomputed
+ * when any of the timer registers are written.
+ */
+class Timer {
+public:
+    static constexpr uint16_t div_address = 0xff04;
+    static constexpr uint16_t tima_address = 0xff05;
+    static constexpr uint16_t tma_address = 0xff06;
+    static constexpr uint16_t tac_address = 0xff07;
+
+    static constexpr unsigned long never = ULONG_MAX;
+
+    Timer()
+      : div_base_(0),
+        tima_clock_(0),
+        tima_(0),
+        tma_(0),
+        tac_(0)
+    { }
+
+    inline uint8_t div(unsigned long clock) const
+    {
+        return static_cast<uint8_t>((clock - div_base_) / div_period);
+    }
+
+    inline uint8_t tima(unsigned long clock) const
+    {
+        return static_cast<uint8_t>(tima_ + increments(tima_clock_, clock));
+    }
+
+    inline uint8_t tma() const
+    {
+        return tma_;
+    }
+
+    inline uint8_t tac() const
+    {
+        return 0xf8 | tac_;
+    }
+
+    inline bool enabled() const
+    {
+        return tac_ & 0x04;
+    }
+
+    /* Length of a TIMA increment in cycles for the current TAC setting */
+    inline unsigned long period() const
+    {
+        static const unsigned long periods[] = { 256, 4, 16, 64 };
+        return periods[tac_ & 0x03];
+    }
+
+    /* Number of TIMA increments in (from, to] */
+    inline unsigned long increments(unsigned long from, unsigned long to) const
+    {
+        if (!enabled())
+            return 0;
+        return (to - div_base_) / period() - (from - div_base_) / period();
+    }
+
+    inline unsigned long next_div(unsigned long clock) const
+    {
+        return div_base_ + ((clock - div_base_) / div_period + 1) * div_period;
+    }
+
+    inline unsigned long next_increment(unsigned long clock) const
+    {
+        if (!enabled())
+            return never;
+        return div_base_ + ((clock - div_base_) / period() + 1) * period();
+    }
+
+    inline unsigned long overflow_clock() const
+    {
+        if (!enabled())
+            return never;
+        auto start = (tima_clock_ - div_base_) / period();
+        return div_base_ + (start + 0x100 - tima_) * period();
+    }
+
+    /* Bring TIMA up to date, reloading from TMA and requesting an interrupt
+     * for every overflow up to and including clock.
+     */
+    void update(GameboyImpl &gb, unsigned long clock);
+
+    void set_div(GameboyImpl &gb, unsigned long clock);
+    void set_tima(GameboyImpl &gb, uint8_t value, unsigned long clock);
+    void set_tma(uint8_t value);
+    void set_tac(GameboyImpl &gb, uint8_t value, unsigned long clock);
+
+    void reset();
+
+    void save_state(StateWriter &state) const;
+    void load_state(StateReader &state);
+
+    void attach(Mmu &mmu, Scheduler &scheduler);
+
+private:
+    static constexpr unsigned long div_period = 64;
+
+    void reschedule(GameboyImpl &gb);
+
+    unsigned long div_base_;
+    unsigned long tima_clock_;
+    uint8_t tima_;
+    uint8_t tma_;
+    uint8_t tac_;
+};
+
+}
+
+#endif /* TIMER_HPP_ */
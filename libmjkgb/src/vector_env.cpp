@@ -0,0 +1,158 @@
+#include <algorithm>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#include "mjkgb.hpp"
+#include "batch_impl.hpp"
+#include "gameboy_impl.hpp"
+
+namespace mjkgb {
+
+using namespace std;
+
+class VectorEnv::impl {
+public:
+    struct Range {
+        uint16_t address;
+        size_t size;
+    };
+
+    impl(const Gameboy &prototype, size_t count, unsigned threads)
+      : batch_(prototype, count, threads),
+        action_(),
+        ranges_(),
+        frame_size_(0),
+        stack_(1),
+        skip_(1),
+        max_pool_(false),
+        last_()
+    { }
+
+    inline size_t observation_size() const
+    {
+        return stack_ * frame_size_;
+    }
+
+    void gather(const Gameboy &gb, uint8_t *out) const
+    {
+        const auto &mmu = gb.pimpl_->mmu_;
+        for (const auto &range : ranges_) {
+            mmu.peek(range.address, out, range.size);
+            out += range.size;
+        }
+    }
+
+    void step(size_t index, Gameboy &gb, uint8_t action, uint8_t *slot)
+    {
+        if (action_)
+            action_(index, action, gb);
+        else
+            gb.setButtons(action);
+
+        /* The frame before the last is only needed when pooling, with a skip
+         * of one it is left over from the previous step
+         */
+        auto last = &last_[index * frame_size_];
+        for (size_t frame = 0; frame < skip_; ++frame) {
+            gb.pimpl_->run_frame();
+            if (max_pool_ && frame + 2 == skip_)
+                gather(gb, last);
+        }
+
+        auto newest = slot + (stack_ - 1) * frame_size_;
+        memmove(slot, slot + frame_size_, (stack_ - 1) * frame_size_);
+        gather(gb, newest);
+
+        if (max_pool_) {
+            for (size_t i = 0; i < frame_size_; ++i) {
+                auto value = newest[i];
+                newest[i] = max(value, last[i]);
+                last[i] = value;
+            }
+        }
+    }
+
+    Batch batch_;
+    action_cb action_;
+
+    vector<Range> ranges_;
+    size_t frame_size_;
+    size_t stack_;
+    size_t skip_;
+    bool max_pool_;
+
+    /* Previous frame of each machine, for max pooling */
+    vector<uint8_t> last_;
+};
+
+VectorEnv::VectorEnv(const Gameboy &prototype, size_t count, unsigned threads)
+  : pimpl_(new VectorEnv::impl(prototype, count, threads))
+{ }
+
+VectorEnv::~VectorEnv()
+{ }
+
+size_t VectorEnv::size() const
+{
+    return pimpl_->batch_.size();
+}
+
+Gameboy &VectorEnv::operator[](size_t index)
+{
+    return pimpl_->batch_[index];
+}
+
+void VectorEnv::addRamObservation(uint16_t address, size_t size)
+{
+    pimpl_->ranges_.push_back({ address, size });
+    pimpl_->frame_size_ += size;
+    pimpl_->last_.assign(pimpl_->frame_size_ * pimpl_->batch_.size(), 0);
+}
+
+void VectorEnv::setFrameStack(size_t frames)
+{
+    pimpl_->stack_ = max<size_t>(frames, 1);
+}
+
+void VectorEnv::setFrameSkip(size_t frames)
+{
+    pimpl_->skip_ = max<size_t>(frames, 1);
+}
+
+void VectorEnv::setMaxPool(bool enabled)
+{
+    pimpl_->max_pool_ = enabled;
+}
+
+size_t VectorEnv::observationSize() const
+{
+    return pimpl_->observation_size();
+}
+
+void VectorEnv::setActionCallback(action_cb callback)
+{
+    pimpl_->action_ = move(callback);
+}
+
+void VectorEnv::observe(uint8_t *observations, size_t stride)
+{
+    auto &env = *pimpl_;
+    env.batch_.pimpl_->each([&](size_t index, Gameboy &gb) {
+        auto slot = observations + index * stride;
+        env.gather(gb, slot);
+        for (size_t frame = 1; frame < env.stack_; ++frame)
+            memcpy(slot + frame * env.frame_size_, slot, env.frame_size_);
+        memcpy(&env.last_[index * env.frame_size_], slot, env.frame_size_);
+    });
+}
+
+void VectorEnv::step(const uint8_t *actions, uint8_t *observations, size_t stride)
+{
+    auto &env = *pimpl_;
+    env.batch_.pimpl_->each([&](size_t index, Gameboy &gb) {
+        env.step(index, gb, actions[index], observations + index * stride);
+    });
+}
+
+}
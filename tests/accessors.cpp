@@ -86,6 +86,7 @@ TEST_F(AccessorsTest, Ignore) {
 }
 
 TEST_F(AccessorsTest, BytePointer) {
+    gb.set(ByteRegister::A, 0x80);
     auto ptr0 = byte_ptr(ByteRegister::A);
     EXPECT_EQ(0, gb.get(ptr0));
 
@@ -98,7 +99,7 @@ TEST_F(AccessorsTest, BytePointer) {
     auto ptr1 = byte_ptr(WordRegister::HL);
     EXPECT_EQ(0, gb.get(ptr1));
 
-    gb.set(WordRegister::HL, 0xff00);
+    gb.set(WordRegister::HL, 0xff80);
     EXPECT_EQ(0xdf, gb.get(ptr1));
 
     gb.set(ptr1, 0xbe);
@@ -108,22 +109,23 @@ TEST_F(AccessorsTest, BytePointer) {
     EXPECT_EQ(0xbf, gb.get(ptr1));
 
     auto ptr2 = byte_ptr<1>(WordRegister::HL);
-    EXPECT_EQ(0xff00, gb.get(WordRegister::HL));
+    EXPECT_EQ(0xff80, gb.get(WordRegister::HL));
     EXPECT_EQ(0xbf, gb.get(ptr2));
-    EXPECT_EQ(0xff01, gb.get(WordRegister::HL));
+    EXPECT_EQ(0xff81, gb.get(WordRegister::HL));
     EXPECT_EQ(0x0, gb.get(ptr2));
-    EXPECT_EQ(0xff02, gb.get(WordRegister::HL));
+    EXPECT_EQ(0xff82, gb.get(WordRegister::HL));
 
     auto ptr3 = byte_ptr<-1>(WordRegister::HL);
-    EXPECT_EQ(0xff02, gb.get(WordRegister::HL));
+    EXPECT_EQ(0xff82, gb.get(WordRegister::HL));
     EXPECT_EQ(0x0, gb.get(ptr3));
-    EXPECT_EQ(0xff01, gb.get(WordRegister::HL));
+    EXPECT_EQ(0xff81, gb.get(WordRegister::HL));
     EXPECT_EQ(0x0, gb.get(ptr3));
-    EXPECT_EQ(0xff00, gb.get(WordRegister::HL));
+    EXPECT_EQ(0xff80, gb.get(WordRegister::HL));
     EXPECT_EQ(0xbf, gb.get(ptr3));
 }
 
 TEST_F(AccessorsTest, WordPointer) {
+    gb.set(ByteRegister::A, 0x80);
     auto ptr0 = word_ptr(ByteRegister::A);
     EXPECT_EQ(0, gb.get(ptr0));
 
@@ -136,7 +138,7 @@ TEST_F(AccessorsTest, WordPointer) {
     auto ptr1 = word_ptr(WordRegister::HL);
     EXPECT_EQ(0, gb.get(ptr1));
 
-    gb.set(WordRegister::HL, 0xff00);
+    gb.set(WordRegister::HL, 0xff80);
     EXPECT_EQ(0xdeae, gb.get(ptr1));
 
     gb.set(ptr1, 0xbeef);
@@ -146,18 +148,18 @@ TEST_F(AccessorsTest, WordPointer) {
     EXPECT_EQ(0xbef0, gb.get(ptr1));
 
     auto ptr2 = word_ptr<1>(WordRegister::HL);
-    EXPECT_EQ(0xff00, gb.get(WordRegister::HL));
+    EXPECT_EQ(0xff80, gb.get(WordRegister::HL));
     EXPECT_EQ(0xbef0, gb.get(ptr2));
-    EXPECT_EQ(0xff01, gb.get(WordRegister::HL));
+    EXPECT_EQ(0xff81, gb.get(WordRegister::HL));
     EXPECT_EQ(0xbe, gb.get(ptr2));
-    EXPECT_EQ(0xff02, gb.get(WordRegister::HL));
+    EXPECT_EQ(0xff82, gb.get(WordRegister::HL));
 
     auto ptr3 = word_ptr<-1>(WordRegister::HL);
-    EXPECT_EQ(0xff02, gb.get(WordRegister::HL));
+    EXPECT_EQ(0xff82, gb.get(WordRegister::HL));
     EXPECT_EQ(0x0, gb.get(ptr3));
-    EXPECT_EQ(0xff01, gb.get(WordRegister::HL));
+    EXPECT_EQ(0xff81, gb.get(WordRegister::HL));
     EXPECT_EQ(0xbe, gb.get(ptr3));
-    EXPECT_EQ(0xff00, gb.get(WordRegister::HL));
+    EXPECT_EQ(0xff80, gb.get(WordRegister::HL));
     EXPECT_EQ(0xbef0, gb.get(ptr3));
 }
 
@@ -166,8 +168,8 @@ TEST_F(AccessorsTest, ByteImmediate) {
     EXPECT_EQ(0, gb.get(ByteImmediate()));
     EXPECT_EQ(1, gb.get(WordRegister::PC));
 
-    gb.set(WordRegister::HL, 1);
-    gb.set(byte_ptr(WordRegister::HL), 0xde);
+    /* Immediates are read from ROM, which the CPU can't write */
+    gb.mmu_.poke(1, 0xde);
     EXPECT_EQ(0xde, gb.get(ByteImmediate()));
     EXPECT_EQ(2, gb.get(WordRegister::PC));
 }
@@ -177,8 +179,8 @@ TEST_F(AccessorsTest, WordImmediate) {
     EXPECT_EQ(0, gb.get(WordImmediate()));
     EXPECT_EQ(2, gb.get(WordRegister::PC));
 
-    gb.set(WordRegister::HL, 2);
-    gb.set(word_ptr(WordRegister::HL), 0xdead);
+    gb.mmu_.poke(2, 0xad);
+    gb.mmu_.poke(3, 0xde);
     EXPECT_EQ(0xdead, gb.get(WordImmediate()));
     EXPECT_EQ(4, gb.get(WordRegister::PC));
 }
@@ -0,0 +1,136 @@
+#include <algorithm>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "gameboy_impl.hpp"
+
+namespace {
+
+using namespace std;
+using namespace mjkgb;
+
+class ApuTest : public testing::Test {
+protected:
+    void write(uint16_t address, uint8_t value)
+    {
+        gb.mmu_.set(address, value);
+    }
+
+    uint8_t read(uint16_t address)
+    {
+        return gb.mmu_.get(address);
+    }
+
+    void advance(unsigned long cycles)
+    {
+        gb.cpu_.skip(cycles);
+        gb.apu_.update(gb, gb.cpu_.get_clock());
+    }
+
+    GameboyImpl gb;
+};
+
+TEST_F(ApuTest, SquareWave) {
+    write(0xff24, 0x77);
+    write(0xff25, 0xff);
+    write(0xff11, 0x80);
+    write(0xff12, 0xf0);
+    write(0xff13, 0x00);
+    write(0xff14, 0x87);
+    EXPECT_EQ(0xf1, read(Apu::nr52_address));
+
+    /* 1/4 of a second */
+    advance(1 << 18);
+
+    auto rate = gb.apu_.sample_rate();
+    vector<int16_t> samples(2 * rate);
+    auto frames = gb.apu_.read_samples(samples.data(), samples.size()) / 2;
+    EXPECT_NEAR(rate / 4, frames, rate / 4 / 10);
+
+    /* Band-limiting rings a little around each edge, and the DC blocker
+     * centres the wave, so only check the swing is about the right size once
+     * the blocker has settled
+     */
+    auto minmax = minmax_element(samples.begin() + 3 * frames / 2, samples.begin() + 2 * frames);
+    auto swing = *minmax.second - *minmax.first;
+    EXPECT_LE(64 * 15 * 8, swing);
+    EXPECT_GE(64 * 15 * 8 * 4 / 3, swing);
+}
+
+TEST_F(ApuTest, SampleRate) {
+    gb.apu_.set_sample_rate(22050);
+    write(0xff12, 0xf0);
+    write(0xff14, 0x87);
+    advance(1 << 16);
+
+    vector<int16_t> samples(2 * 48000);
+    auto frames = gb.apu_.read_samples(samples.data(), samples.size()) / 2;
+    EXPECT_NEAR(22050 / 16, frames, 22050 / 16 / 10);
+}
+
+TEST_F(ApuTest, SampleRateClamped) {
+    gb.apu_.set_sample_rate(0);
+    EXPECT_EQ(Apu::min_sample_rate, gb.apu_.sample_rate());
+
+    gb.apu_.set_sample_rate(~0u);
+    EXPECT_EQ(Apu::max_sample_rate, gb.apu_.sample_rate());
+
+    write(0xff12, 0xf0);
+    write(0xff14, 0x87);
+    advance(1 << 16);
+
+    vector<int16_t> samples(2 * Apu::max_sample_rate);
+    auto frames = gb.apu_.read_samples(samples.data(), samples.size()) / 2;
+    EXPECT_NEAR(Apu::max_sample_rate / 16, frames, Apu::max_sample_rate / 16 / 10);
+}
+
+TEST_F(ApuTest, SynthesisDisabled) {
+    gb.apu_.set_synthesis(false);
+    write(0xff12, 0xf0);
+    write(0xff11, 0x3f);
+    write(0xff14, 0xc7);
+    EXPECT_EQ(0xf1, read(Apu::nr52_address));
+
+    advance(1 << 16);
+    EXPECT_EQ(0xf0, read(Apu::nr52_address));
+    EXPECT_EQ(0u, gb.apu_.available());
+
+    gb.apu_.set_synthesis(true);
+    advance(1 << 16);
+    EXPECT_LT(0u, gb.apu_.available());
+}
+
+TEST_F(ApuTest, Length) {
+    write(0xff12, 0xf0);
+    write(0xff11, 0x3f);
+    write(0xff14, 0xc0);
+    EXPECT_EQ(0xf1, read(Apu::nr52_address));
+
+    /* The first length step comes after 2048 cycles */
+    advance(2047);
+    EXPECT_EQ(0xf1, read(Apu::nr52_address));
+    advance(1);
+    EXPECT_EQ(0xf0, read(Apu::nr52_address));
+}
+
+TEST_F(ApuTest, SweepOverflow) {
+    write(0xff10, 0x11);
+    write(0xff12, 0xf0);
+    write(0xff13, 0xff);
+    write(0xff14, 0x87);
+    EXPECT_EQ(0xf0, read(Apu::nr52_address));
+}
+
+TEST_F(ApuTest, PowerOff) {
+    write(0xff12, 0xf0);
+    write(0xff14, 0x80);
+    write(Apu::nr52_address, 0x00);
+    EXPECT_EQ(0x70, read(Apu::nr52_address));
+    EXPECT_EQ(0x00, read(0xff12));
+
+    write(0xff12, 0xf0);
+    EXPECT_EQ(0x00, read(0xff12));
+}
+
+}
@@ -0,0 +1,46 @@
+#include <atomic>
+#include <sstream>
+
+#include <gtest/gtest.h>
+
+#include "mjkgb.hpp"
+
+namespace {
+
+using namespace std;
+using namespace mjkgb;
+
+TEST(BatchTest, Rounds) {
+    /* LD HL, 0xc000; loop: INC (HL); JR loop */
+    stringstream code{string{"\x21\x00\xc0\x34\x18\xfd", 6}};
+    Gameboy prototype;
+    prototype.load(code);
+
+    Batch batch{prototype, 16, 4};
+    EXPECT_EQ(16u, batch.size());
+
+    atomic<int> calls[16] = {};
+    batch.setInputCallback([&](size_t index, Gameboy &) {
+        ++calls[index];
+    });
+    batch.setRamOutput(0xc000, 1);
+
+    batch.runCycles(1000);
+    auto count = batch.ram(0)[0];
+    EXPECT_LT(0, count);
+    for (size_t i = 0; i < batch.size(); ++i) {
+        EXPECT_EQ(1, calls[i]);
+        EXPECT_EQ(count, batch.ram(i)[0]);
+    }
+
+    /* Machines pick up where they left off */
+    batch.runCycles(1000);
+    auto next = batch.ram(0)[0];
+    EXPECT_LT(count, next);
+    for (size_t i = 0; i < batch.size(); ++i) {
+        EXPECT_EQ(2, calls[i]);
+        EXPECT_EQ(next, batch.ram(i)[0]);
+    }
+}
+
+}
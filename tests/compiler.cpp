@@ -1,4 +1,5 @@
 #include <sstream>
+#include <thread>
 
 #include <gtest/gtest.h>
 
@@ -18,8 +19,11 @@ protected:
 
 TEST_F(CompilerTest, SimpleJIT) {
     /* LD A, B; STOP */
+    stringstream code{string{"\x78\x10\x00", 3}};
+    gb.load(code);
+
     auto code0 = reinterpret_cast<void (*)(GameboyImpl &)>(
-            comp.compile(0, { 0x78, 0x10, 0x00 }));
+            comp.compile(0, Jit::decode(gb.mmu_, 0), Compiler::Tier::BASELINE));
     ASSERT_NE(code0, nullptr);
 
     gb.set(ByteRegister::A, 0);
@@ -29,8 +33,58 @@ TEST_F(CompilerTest, SimpleJIT) {
     EXPECT_EQ(0x42, gb.get(ByteRegister::A));
     EXPECT_EQ(0x42, gb.get(ByteRegister::B));
 
-    EXPECT_EQ(2, gb.cpu_.get_clock());
+    /* Timed as the interpreter would */
+    EXPECT_EQ(4, gb.cpu_.get_clock());
+    EXPECT_EQ(2, gb.get(WordRegister::PC));
+    EXPECT_TRUE(gb.cpu_.is_stopped());
 }
 
+TEST_F(CompilerTest, Independent) {
+    /* INC A; STOP */
+    stringstream code{string{"\x3c\x10\x00", 3}};
+    gb.load(code);
+    auto block = Jit::decode(gb.mmu_, 0);
+
+    /* Compilers share nothing but the native target, so two can compile at
+     * once on different threads, each into code of its own
+     */
+    Compiler other;
+    uintptr_t first = 0;
+    thread worker{[&] { first = other.compile(0, block, Compiler::Tier::OPTIMIZED); }};
+    auto second = comp.compile(0, block, Compiler::Tier::BASELINE);
+    worker.join();
+    ASSERT_NE(0u, first);
+    ASSERT_NE(0u, second);
+    EXPECT_NE(first, second);
+
+    for (auto native : { first, second }) {
+        gb.cpu_.reset();
+        gb.set(WordRegister::PC, 0);
+        gb.set(ByteRegister::A, 0x41);
+        reinterpret_cast<void (*)(GameboyImpl &)>(native)(gb);
+        EXPECT_EQ(0x42, gb.get(ByteRegister::A));
+    }
 }
 
+TEST_F(CompilerTest, Tiers) {
+    /* LD B, 0x10; INC A; SWAP A; ADD A, B; STOP */
+    stringstream code{string{"\x06\x10\x3c\xcb\x37\x80\x10\x00", 8}};
+    gb.load(code);
+    auto block = Jit::decode(gb.mmu_, 0);
+
+    for (auto tier : { Compiler::Tier::BASELINE, Compiler::Tier::OPTIMIZED }) {
+        auto native = reinterpret_cast<void (*)(GameboyImpl &)>(comp.compile(0, block, tier));
+        ASSERT_NE(nullptr, native);
+
+        gb.cpu_.reset();
+        gb.set(WordRegister::PC, 0);
+        gb.set(ByteRegister::A, 0x01);
+        native(gb);
+
+        EXPECT_EQ(0x30, gb.get(ByteRegister::A));
+        EXPECT_EQ(7, gb.get(WordRegister::PC));
+        EXPECT_TRUE(gb.cpu_.is_stopped());
+    }
+}
+
+}
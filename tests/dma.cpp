@@ -0,0 +1,57 @@
+#include <gtest/gtest.h>
+
+#include "gameboy_impl.hpp"
+
+namespace {
+
+using namespace std;
+using namespace mjkgb;
+
+class DmaTest : public testing::Test {
+protected:
+    GameboyImpl gb;
+};
+
+TEST_F(DmaTest, Transfer) {
+    for (uint16_t i = 0; i < Dma::oam_size; ++i)
+        gb.mmu_.set(0xc000 + i, static_cast<uint8_t>(i + 1));
+    gb.mmu_.set(0xff80, 0x42);
+
+    gb.mmu_.set(Dma::dma_address, 0xc0);
+    EXPECT_TRUE(gb.dma_.active());
+    EXPECT_EQ(0xc0, gb.mmu_.get(Dma::dma_address));
+    EXPECT_EQ(Dma::transfer_cycles, gb.scheduler_.deadline(Event::DMA_END));
+
+    for (uint16_t i = 0; i < Dma::oam_size; ++i)
+        EXPECT_EQ(i + 1, gb.mmu_.peek(Dma::oam_address + i));
+
+    /* Only HRAM and I/O registers are accessible during the transfer */
+    EXPECT_EQ(0xff, gb.mmu_.get(0xc000));
+    EXPECT_EQ(0x42, gb.mmu_.get(0xff80));
+    gb.mmu_.set(0xc000, 0);
+    EXPECT_EQ(1, gb.mmu_.peek(0xc000));
+
+    gb.cpu_.skip(Dma::transfer_cycles);
+    gb.scheduler_.dispatch(gb, gb.cpu_.get_clock());
+    EXPECT_FALSE(gb.dma_.active());
+    EXPECT_EQ(1, gb.mmu_.get(0xc000));
+}
+
+TEST_F(DmaTest, HramRoutine) {
+    /* LD A, 0xc0; LDH (0x46), A; LD A, 0x28; DEC A; JR NZ, -3; STOP */
+    const uint8_t routine[] = {
+        0x3e, 0xc0, 0xe0, 0x46, 0x3e, 0x28, 0x3d, 0x20, 0xfd, 0x10, 0x00
+    };
+    for (uint16_t i = 0; i < sizeof(routine); ++i)
+        gb.mmu_.poke(0xff80 + i, routine[i]);
+    gb.mmu_.poke(0xc010, 0x42);
+
+    gb.set(WordRegister::PC, 0xff80);
+    gb.run();
+
+    EXPECT_EQ(0, gb.get(ByteRegister::A));
+    EXPECT_EQ(0x42, gb.mmu_.get(Dma::oam_address + 0x10));
+    EXPECT_FALSE(gb.dma_.active());
+}
+
+}
@@ -0,0 +1,67 @@
+#include <sstream>
+
+#include <gtest/gtest.h>
+
+#include "gameboy_impl.hpp"
+
+namespace {
+
+using namespace std;
+using namespace mjkgb;
+
+class IdleLoopTest : public testing::Test {
+protected:
+    GameboyImpl gb;
+};
+
+TEST_F(IdleLoopTest, PollRegister) {
+    /* LDH A, (0x44); CP 0x90; JR NZ, -6 */
+    stringstream code0{string{"\xf0\x44\xfe\x90\x20\xfa", 6}};
+    gb.load(code0);
+    EXPECT_EQ(0xff44, IdleLoop::poll_register(gb.mmu_, 0, 6));
+    EXPECT_EQ(IdleLoop::no_register, IdleLoop::poll_register(gb.mmu_, 0, 4));
+
+    /* LD A, (0xff41); AND 0x03; JP Z, 0x0000 */
+    stringstream code1{string{"\xfa\x41\xff\xe6\x03\xca\x00\x00", 8}};
+    gb.load(code1);
+    EXPECT_EQ(0xff41, IdleLoop::poll_register(gb.mmu_, 0, 8));
+
+    /* LD A, (0xc000); CP 0x90; JR NZ, -7 */
+    stringstream code2{string{"\xfa\x00\xc0\xfe\x90\x20\xf9", 7}};
+    gb.load(code2);
+    EXPECT_EQ(IdleLoop::no_register, IdleLoop::poll_register(gb.mmu_, 0, 7));
+
+    /* LDH A, (0x44); INC B; JR NZ, -5 */
+    stringstream code3{string{"\xf0\x44\x04\x20\xfb", 5}};
+    gb.load(code3);
+    EXPECT_EQ(IdleLoop::no_register, IdleLoop::poll_register(gb.mmu_, 0, 5));
+}
+
+TEST_F(IdleLoopTest, SkipMatchesFullEmulation) {
+    /* LDH A, (0x44); CP 0x90; JR NZ, -6; STOP */
+    string code{"\xf0\x44\xfe\x90\x20\xfa\x10\x00", 8};
+
+    stringstream code0{code};
+    gb.load(code0);
+    gb.idle_.set_enabled(false);
+    gb.set(WordRegister::PC, 0);
+    gb.run();
+
+    auto clock = gb.cpu_.get_clock();
+    EXPECT_EQ(0x90, gb.get(ByteRegister::A));
+    EXPECT_EQ(0x90, gb.lcd_.ly(clock));
+    EXPECT_EQ(0, gb.idle_.skipped());
+
+    stringstream code1{code};
+    gb.load(code1);
+    gb.idle_.set_enabled(true);
+    gb.set(WordRegister::PC, 0);
+    gb.set(ByteRegister::A, 0);
+    gb.run();
+
+    EXPECT_EQ(0x90, gb.get(ByteRegister::A));
+    EXPECT_EQ(clock, gb.cpu_.get_clock());
+    EXPECT_LT(0, gb.idle_.skipped());
+}
+
+}
@@ -0,0 +1,531 @@
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include "gameboy_impl.hpp"
+
+namespace {
+
+using namespace std;
+using namespace mjkgb;
+
+class JitTest : public testing::Test {
+protected:
+    GameboyImpl gb;
+
+    void load(const string &code)
+    {
+        stringstream stream{code};
+        gb.load(stream);
+    }
+};
+
+TEST_F(JitTest, Decode) {
+    /* LD A, 0x01; SWAP A; SET 1, E; JR NZ, -7; NOP */
+    load(string{"\x3e\x01\xcb\x37\xcb\xcb\x20\xf9\x00", 9});
+    EXPECT_EQ((vector<uint8_t>{ 0x3e, 0x01, 0xcb, 0x37, 0xcb, 0xcb, 0x20, 0xf9 }),
+            Jit::decode(gb.mmu_, 0));
+    EXPECT_EQ((vector<uint8_t>{ 0xcb, 0xcb, 0x20, 0xf9 }), Jit::decode(gb.mmu_, 4));
+
+    /* LD BC, 0x1234; STOP; NOP */
+    load(string{"\x01\x34\x12\x10\x00\x00", 6});
+    EXPECT_EQ((vector<uint8_t>{ 0x01, 0x34, 0x12, 0x10 }), Jit::decode(gb.mmu_, 0));
+
+    /* Nothing but NOPs, to the end of ROM */
+    load(string{});
+    EXPECT_EQ(Jit::max_instructions, Jit::decode(gb.mmu_, 0).size());
+    EXPECT_EQ(2u, Jit::decode(gb.mmu_, Jit::rom_end - 2).size());
+}
+
+TEST_F(JitTest, Discover) {
+    string code(0x201, '\x00');
+    /* JP 0x150 */
+    code.replace(0x100, 3, "\xc3\x50\x01", 3);
+    /* CALL 0x200; JR NZ, +2; JR -2; STOP */
+    code.replace(0x150, 8, "\xcd\x00\x02\x20\x02\x18\xfe\x10", 8);
+    /* RET */
+    code.replace(0x200, 1, "\xc9", 1);
+    load(code);
+
+    vector<uint16_t> expected;
+    for (uint16_t address = 0; address <= 0x60; address += 8)
+        expected.push_back(address);
+    for (auto address : { 0x100, 0x150, 0x153, 0x155, 0x157, 0x200 })
+        expected.push_back(static_cast<uint16_t>(address));
+    EXPECT_EQ(expected, Jit::discover(gb.mmu_));
+}
+
+TEST_F(JitTest, Trace) {
+    /* LD B, 0x10; loop: BIT 0, B; JR Z, +1; INC A; DEC B; JR NZ, loop; STOP */
+    load(string{"\x06\x10\xcb\x40\x28\x01\x3c\x05\x20\xf8\x10", 11});
+    unique_ptr<BranchCounts[]> branches{new BranchCounts[Jit::rom_end + 3]()};
+    bool loops;
+
+    /* Without counts, branches are followed as not taken */
+    auto trace = Jit::trace(gb.mmu_, 2, nullptr, loops);
+    EXPECT_FALSE(loops);
+    ASSERT_EQ(3u, trace.size());
+    EXPECT_EQ(2, trace[0].first);
+    EXPECT_EQ((vector<uint8_t>{ 0xcb, 0x40, 0x28, 0x01 }), trace[0].second);
+    EXPECT_EQ(6, trace[1].first);
+    EXPECT_EQ(0x0a, trace[2].first);
+
+    /* Taken branches followed round to the start make a loop */
+    branches[0x06].taken = 10;
+    branches[0x0a].taken = 10;
+    trace = Jit::trace(gb.mmu_, 2, branches.get(), loops);
+    EXPECT_TRUE(loops);
+    ASSERT_EQ(2u, trace.size());
+    EXPECT_EQ(7, trace[1].first);
+    EXPECT_EQ((vector<uint8_t>{ 0x05, 0x20, 0xf8 }), trace[1].second);
+
+    branches[0x06].not_taken = 20;
+    trace = Jit::trace(gb.mmu_, 2, branches.get(), loops);
+    EXPECT_TRUE(loops);
+    ASSERT_EQ(2u, trace.size());
+    EXPECT_EQ(6, trace[1].first);
+}
+
+TEST_F(JitTest, Cycles) {
+    /* LD A, 0x01; SWAP A; SET 1, E; JR NZ, -7, counted as taken */
+    load(string{"\x3e\x01\xcb\x37\xcb\xcb\x20\xf9", 8});
+    EXPECT_EQ(17u, Jit::cycles(Jit::decode(gb.mmu_, 0)));
+
+    /* CALL NZ, 0x0000; RET NZ */
+    load(string{"\xc4\x00\x00\xc0", 4});
+    EXPECT_EQ(8u, Jit::cycles(Jit::decode(gb.mmu_, 0)));
+    EXPECT_EQ(7u, Jit::cycles(Jit::decode(gb.mmu_, 3)));
+}
+
+TEST_F(JitTest, CyclesMatchInterpreter) {
+    /* Ticks taken by the interpreter for the instruction at 0 */
+    auto run = [](const vector<uint8_t> &instruction, uint8_t flags) {
+        GameboyImpl gb;
+        string code{instruction.begin(), instruction.end()};
+        code.resize(0x200, '\0');
+        stringstream stream{code};
+        gb.load(stream);
+        gb.cpu_.set(WordRegister::PC, 0, false);
+        gb.cpu_.set(WordRegister::SP, 0xdff0, false);
+        gb.cpu_.set(WordRegister::BC, 0xc000, false);
+        gb.cpu_.set(WordRegister::DE, 0xc000, false);
+        gb.cpu_.set(WordRegister::HL, 0xc000, false);
+        gb.set(ByteRegister::F, flags);
+        auto start = gb.cpu_.get_clock();
+        gb.run_until(start + 1);
+        return gb.cpu_.get_clock() - start;
+    };
+
+    /* The budget is what the slower way through a conditional jump takes */
+    for (unsigned prefix : { 0x00u, 0xcbu }) {
+        for (unsigned opcode = 0; opcode < 0x100; ++opcode) {
+            vector<uint8_t> instruction;
+            if (prefix)
+                instruction = { 0xcb, static_cast<uint8_t>(opcode) };
+            else
+                instruction.resize(Jit::length(static_cast<uint8_t>(opcode)),
+                        static_cast<uint8_t>(opcode));
+            if (!prefix && opcode == 0xcb)
+                continue;
+
+            auto taken = max(run(instruction, 0x00), run(instruction, 0xf0));
+            EXPECT_EQ(taken, Jit::cycles(instruction))
+                << hex << prefix << " " << opcode;
+        }
+    }
+}
+
+TEST_F(JitTest, Threshold) {
+    load(string{});
+    EXPECT_EQ(nullptr, gb.jit_.get_hook());
+
+    gb.jit_.set_threshold(3);
+    ASSERT_NE(nullptr, gb.jit_.get_hook());
+    EXPECT_EQ(0u, gb.jit_.visit(gb, 0x100));
+    EXPECT_EQ(0u, gb.jit_.visit(gb, 0x100));
+
+    /* RAM is never compiled */
+    for (auto i = 0; i < 3; ++i)
+        EXPECT_EQ(0u, gb.jit_.visit(gb, 0xc000));
+    EXPECT_EQ(0u, gb.mmu_.get_native(0xc000));
+
+    /* The third visit compiles, and later ones don't try again */
+    auto native = gb.jit_.visit(gb, 0x100);
+    ASSERT_NE(0u, native);
+    EXPECT_EQ(native, gb.mmu_.get_native(0x100));
+    EXPECT_EQ(1u, gb.jit_.compiled());
+    EXPECT_EQ(native, gb.jit_.visit(gb, 0x100));
+    EXPECT_EQ(1u, gb.jit_.compiled());
+
+    gb.jit_.set_threshold(0);
+    EXPECT_EQ(nullptr, gb.jit_.get_hook());
+}
+
+TEST_F(JitTest, TierUp) {
+    /* JR -2 */
+    string code{"\x18\xfe", 2};
+    load(code);
+    gb.jit_.set_threshold(1);
+    gb.jit_.set_optimize_threshold(3);
+
+    auto baseline = gb.jit_.visit(gb, 0);
+    ASSERT_NE(0u, baseline);
+    EXPECT_EQ(baseline, gb.jit_.enter(gb, 0, baseline));
+    EXPECT_EQ(baseline, gb.jit_.enter(gb, 0, baseline));
+    EXPECT_EQ(0u, gb.jit_.optimized());
+
+    /* Swapped in on the third entry, and only once */
+    auto optimized = gb.jit_.enter(gb, 0, baseline);
+    ASSERT_NE(0u, optimized);
+    EXPECT_NE(baseline, optimized);
+    EXPECT_EQ(optimized, gb.mmu_.get_native(0));
+    EXPECT_EQ(1u, gb.jit_.optimized());
+    EXPECT_EQ(optimized, gb.jit_.enter(gb, 0, optimized));
+    EXPECT_EQ(1u, gb.jit_.optimized());
+
+    /* Machines finding it published never go through the baseline */
+    GameboyImpl other;
+    stringstream stream{code};
+    other.load(stream);
+    other.jit_.set_threshold(1);
+    other.jit_.set_optimize_threshold(3);
+    EXPECT_EQ(optimized, other.jit_.visit(other, 0));
+    for (auto i = 0; i < 3; ++i)
+        EXPECT_EQ(optimized, other.jit_.enter(other, 0, optimized));
+    EXPECT_EQ(0u, other.jit_.compiled());
+    EXPECT_EQ(0u, other.jit_.optimized());
+}
+
+TEST_F(JitTest, SharedCache) {
+    /* JR -2 */
+    string code{"\x18\xfe", 2};
+    load(code);
+
+    GameboyImpl other;
+    stringstream stream{code};
+    other.load(stream);
+    EXPECT_EQ(gb.code_, other.code_);
+
+    load(string{"\x00", 1});
+    EXPECT_NE(gb.code_, other.code_);
+    weak_ptr<CodeCache> cache{other.code_};
+    stringstream stream2{code};
+    gb.load(stream2);
+    EXPECT_EQ(gb.code_, other.code_);
+
+    /* Code compiled by one machine is picked up by the other on its first
+     * jump there
+     */
+    gb.jit_.set_threshold(1);
+    other.jit_.set_threshold(100);
+    auto native = gb.jit_.visit(gb, 0);
+    ASSERT_NE(0u, native);
+    EXPECT_EQ(native, other.jit_.visit(other, 0));
+    EXPECT_EQ(native, other.mmu_.get_native(0));
+    EXPECT_EQ(0u, other.jit_.compiled());
+    EXPECT_EQ(1u, gb.code_->size());
+
+    /* Unless its ROM no longer matches, operands included */
+    other.mmu_.poke(1, 0xfd);
+    other.mmu_.set_native(0, 0);
+    EXPECT_EQ(0u, other.jit_.visit(other, 0));
+
+    /* The cache goes once no machine is running the ROM */
+    load(string{});
+    stringstream stream3{string{"\x00", 1}};
+    other.load(stream3);
+    EXPECT_TRUE(cache.expired());
+}
+
+TEST_F(JitTest, CacheFile) {
+    char directory[] = "/tmp/mjkgb-jit-XXXXXX";
+    ASSERT_NE(nullptr, mkdtemp(directory));
+
+    /* JR -2 */
+    load(string{"\x18\xfe", 2});
+    auto hash = CodeCache::hash(gb.mmu_);
+
+    char name[64];
+    snprintf(name, sizeof(name), "/%016" PRIx64 "-%016" PRIx64, hash, Compiler::version());
+    auto path = string{directory} + name;
+
+    /* Files from elsewhere are started afresh */
+    ofstream{path + ".jit"} << "not a block file";
+    {
+        CodeCache cache{hash, directory};
+        cache.wait();
+        EXPECT_EQ(0u, cache.size());
+        ASSERT_NE(nullptr, cache.compile(gb.mmu_, 0));
+    }
+    ifstream file{path + ".jit", ios::binary | ios::ate};
+    EXPECT_EQ(17, file.tellg());
+
+    /* A new cache for the ROM builds a module of the recorded block */
+    {
+        CodeCache cache{hash, directory};
+        cache.wait();
+        EXPECT_EQ(1u, cache.size());
+        EXPECT_NE(nullptr, cache.find(gb.mmu_, 0));
+    }
+    EXPECT_EQ(0, access((path + ".so").c_str(), R_OK));
+
+    /* Which the next one loads as it is created */
+    {
+        CodeCache cache{hash, directory};
+        EXPECT_EQ(1u, cache.size());
+        EXPECT_NE(nullptr, cache.find(gb.mmu_, 0));
+        cache.wait();
+        EXPECT_EQ(1u, cache.size());
+    }
+
+    unlink((path + ".jit").c_str());
+    unlink((path + ".so").c_str());
+    rmdir(directory);
+}
+
+TEST_F(JitTest, StateFromOtherRom) {
+    char directory[] = "/tmp/mjkgb-jit-XXXXXX";
+    ASSERT_NE(nullptr, mkdtemp(directory));
+    CodeCache::set_directory(directory);
+    auto path = [&](const CodeCache &cache) {
+        char name[64];
+        snprintf(name, sizeof(name), "/%016" PRIx64 "-%016" PRIx64 ".jit",
+                cache.rom_hash(), Compiler::version());
+        return string{directory} + name;
+    };
+
+    /* NOP; JR -3 */
+    GameboyImpl other;
+    stringstream stream{string{"\x00\x18\xfd", 3}};
+    other.load(stream);
+    vector<uint8_t> state(other.state_size());
+    state.resize(other.save_snapshot(state.data(), state.size(), false));
+    ASSERT_FALSE(state.empty());
+
+    /* JR -2 */
+    load(string{"\x18\xfe", 2});
+    auto cache = gb.code_;
+    ifstream file{path(*cache), ios::binary | ios::ate};
+    auto size = file.tellg();
+
+    /* Code compiled after loading a state with the other ROM goes to that
+     * ROM's cache
+     */
+    StateReader reader{state.data(), state.size()};
+    ASSERT_TRUE(gb.load_state(reader));
+    EXPECT_EQ(other.code_, gb.code_);
+    gb.jit_.set_threshold(1);
+    ASSERT_NE(0u, gb.jit_.visit(gb, 0));
+    EXPECT_EQ(1u, other.code_->size());
+    EXPECT_EQ(0u, cache->size());
+    ifstream after{path(*cache), ios::binary | ios::ate};
+    EXPECT_EQ(size, after.tellg());
+
+    CodeCache::set_directory("");
+    unlink(path(*cache).c_str());
+    unlink(path(*other.code_).c_str());
+    rmdir(directory);
+}
+
+void precompiled_block(GameboyImpl &gb)
+{
+    gb.set(ByteRegister::A, 0x42);
+}
+
+TEST_F(JitTest, Precompiled) {
+    /* JR -2 */
+    load(string{"\x18\xfe", 2});
+
+    const uint8_t code[] = { 0x18, 0xfe };
+    const PrecompiledBlock blocks[] = {
+        { reinterpret_cast<const void *>(&precompiled_block), code, 0, 2 },
+        { reinterpret_cast<const void *>(&precompiled_block), code, 2, 2 },
+    };
+    const PrecompiledModule module{ Compiler::version(), 0, 2, blocks };
+    CodeCache cache{0, "", &module};
+    EXPECT_EQ(2u, cache.size());
+
+    /* Installed without the JIT, where the ROM matches */
+    cache.install(gb.mmu_);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(&precompiled_block), gb.mmu_.get_native(0));
+    EXPECT_EQ(0u, gb.mmu_.get_native(2));
+
+    gb.jump(0);
+    EXPECT_EQ(0x42, gb.get(ByteRegister::A));
+
+    EXPECT_FALSE(CodeCache::load_module("/nonexistent/module.so"));
+}
+
+/* The fixture ROM and the module mjkgb_precompile built from it, as set by
+ * tests/CMakeLists.txt
+ */
+TEST_F(JitTest, PrecompiledRom) {
+    ASSERT_TRUE(CodeCache::load_module(AOT_FIXTURE_MODULE));
+
+    ifstream rom{AOT_FIXTURE_ROM, ios::binary};
+    ASSERT_TRUE(rom.good());
+    gb.load(rom);
+    ASSERT_NE(0u, gb.mmu_.get_native(0x150));
+    gb.set(WordRegister::PC, 0x100);
+    gb.run();
+
+    /* The same ROM interpreted */
+    GameboyImpl interpreted;
+    ifstream rom2{AOT_FIXTURE_ROM, ios::binary};
+    interpreted.mmu_.load(rom2);
+    interpreted.set(WordRegister::PC, 0x100);
+    interpreted.run();
+    EXPECT_EQ(0u, interpreted.mmu_.get_native(0x150));
+
+    vector<uint8_t> ram(0x10), interpreted_ram(0x10);
+    gb.mmu_.peek(0xc000, ram.data(), ram.size());
+    interpreted.mmu_.peek(0xc000, interpreted_ram.data(), interpreted_ram.size());
+    EXPECT_EQ(interpreted.cpu_.get_clock(), gb.cpu_.get_clock());
+    EXPECT_EQ(interpreted.get(WordRegister::PC), gb.get(WordRegister::PC));
+    EXPECT_EQ(interpreted_ram, ram);
+    EXPECT_EQ(0x08, ram[7]);
+}
+
+TEST_F(JitTest, MatchesInterpreter) {
+    /* LD C, 0x08; LD HL, 0xc000; outer: LD B, 0x10;
+     * inner: INC (HL); SWAP (HL); DEC B; JR NZ, inner;
+     * ADD A, 0x01; LD (HL+), A; DEC C; JR NZ, outer; STOP
+     */
+    string code{"\x0e\x08\x21\x00\xc0\x06\x10\x34\xcb\x36\x05\x20\xfa"
+        "\xc6\x01\x22\x0d\x20\xf2\x10\x00", 21};
+
+    load(code);
+    gb.run();
+    vector<uint8_t> ram(0x10);
+    gb.mmu_.peek(0xc000, ram.data(), ram.size());
+
+    GameboyImpl jit;
+    stringstream stream{code};
+    jit.load(stream);
+    jit.jit_.set_threshold(1);
+    jit.run();
+    vector<uint8_t> jit_ram(0x10);
+    jit.mmu_.peek(0xc000, jit_ram.data(), jit_ram.size());
+
+    EXPECT_EQ(gb.cpu_.get_clock(), jit.cpu_.get_clock());
+    EXPECT_EQ(gb.get(WordRegister::PC), jit.get(WordRegister::PC));
+    EXPECT_EQ(ram, jit_ram);
+    EXPECT_EQ(0x08, ram[7]);
+}
+
+TEST_F(JitTest, TracesMatchInterpreter) {
+    /* LD C, 0x41; outer: LD B, 0x10;
+     * inner: BIT 0, B; JR Z, +1; INC A; DEC B; JR NZ, inner;
+     * DEC C; JR NZ, outer; STOP
+     */
+    string code{"\x0e\x41\x06\x10\xcb\x40\x28\x01\x3c\x05\x20\xf8"
+        "\x0d\x20\xf3\x10\x00", 17};
+
+    load(code);
+    gb.run();
+
+    GameboyImpl jit;
+    stringstream stream{code};
+    jit.load(stream);
+    jit.jit_.set_threshold(1);
+    jit.jit_.set_optimize_threshold(4);
+    jit.run();
+
+    EXPECT_EQ(gb.cpu_.get_clock(), jit.cpu_.get_clock());
+    EXPECT_EQ(gb.get(WordRegister::PC), jit.get(WordRegister::PC));
+    EXPECT_EQ(gb.get(ByteRegister::A), jit.get(ByteRegister::A));
+    EXPECT_EQ(0x08, gb.get(ByteRegister::A));
+}
+
+TEST_F(JitTest, BoundedRunsMatchInterpreter) {
+    /* LD HL, 0xc000; loop: INC (HL); JR loop */
+    string loop{"\x21\x00\xc0\x34\x18\xfd", 6};
+    /* LD HL, 0xc000; loop: INC (HL); NOP x 60; JR loop, long enough for
+     * the end of the run to fall inside the block
+     */
+    string straight{"\x21\x00\xc0\x34", 4};
+    straight += string(60, '\x00') + "\x18\xc1";
+
+    for (const auto &code : { loop, straight }) {
+        GameboyImpl interpreted;
+        stringstream interpreted_stream{code};
+        interpreted.load(interpreted_stream);
+        GameboyImpl jit;
+        stringstream stream{code};
+        jit.load(stream);
+        jit.jit_.set_threshold(1);
+        jit.jit_.set_optimize_threshold(4);
+
+        /* Compiled code stops at the same instruction as the interpreter */
+        for (auto clock : { 100ul, 101ul, 250ul, 1000ul, 1003ul, 1500ul, 1561ul }) {
+            interpreted.run_until(clock);
+            jit.run_until(clock);
+            EXPECT_EQ(interpreted.cpu_.get_clock(), jit.cpu_.get_clock());
+            EXPECT_EQ(interpreted.get(WordRegister::PC), jit.get(WordRegister::PC));
+            EXPECT_EQ(interpreted.mmu_.peek(0xc000), jit.mmu_.peek(0xc000));
+        }
+    }
+}
+
+TEST_F(JitTest, InterruptsMatchInterpreter) {
+    /* JP 0x100 */
+    string code(0x10e, '\x00');
+    code.replace(0, 3, "\xc3\x00\x01", 3);
+    /* STOP, for the VBlank interrupt */
+    code.replace(0x40, 1, "\x10", 1);
+    /* DI; LD A, 0x01; LDH (0xff), A; LDH (0x0f), A; EI;
+     * INC B; INC B; INC B; INC B; STOP
+     */
+    code.replace(0x100, 14, "\xf3\x3e\x01\xe0\xff\xe0\x0f\xfb\x04\x04\x04\x04\x10\x00", 14);
+
+    load(code);
+    gb.run();
+
+    GameboyImpl jit;
+    stringstream stream{code};
+    jit.load(stream);
+    jit.jit_.set_threshold(1);
+    jit.run();
+
+    /* Compiled code leaves after EI for the interrupt to be taken when it
+     * would have been
+     */
+    EXPECT_NE(0u, jit.mmu_.get_native(0x100));
+    EXPECT_EQ(gb.cpu_.get_clock(), jit.cpu_.get_clock());
+    EXPECT_EQ(gb.get(WordRegister::PC), jit.get(WordRegister::PC));
+    EXPECT_EQ(gb.get(ByteRegister::B), jit.get(ByteRegister::B));
+    EXPECT_GT(4, gb.get(ByteRegister::B));
+}
+
+TEST_F(JitTest, ImmediatesMatchInterpreter) {
+    /* LD C, 0x10;
+     * loop: LD A, (0xc001); INC A; LD (0xc001), A; LDH (0x80), A;
+     * DEC C; JR NZ, loop; STOP
+     */
+    string code{"\x0e\x10\xfa\x01\xc0\x3c\xea\x01\xc0\xe0\x80"
+        "\x0d\x20\xf4\x10\x00", 16};
+
+    load(code);
+    gb.run();
+
+    GameboyImpl jit;
+    stringstream stream{code};
+    jit.load(stream);
+    jit.jit_.set_threshold(1);
+    jit.jit_.set_optimize_threshold(4);
+    jit.run();
+
+    EXPECT_EQ(gb.cpu_.get_clock(), jit.cpu_.get_clock());
+    EXPECT_EQ(gb.get(WordRegister::PC), jit.get(WordRegister::PC));
+    EXPECT_EQ(gb.mmu_.peek(0xc001), jit.mmu_.peek(0xc001));
+    EXPECT_EQ(gb.mmu_.peek(0xff80), jit.mmu_.peek(0xff80));
+    EXPECT_EQ(0x10, gb.mmu_.peek(0xc001));
+}
+
+}
@@ -0,0 +1,94 @@
+#include <sstream>
+
+#include <gtest/gtest.h>
+
+#include "gameboy_impl.hpp"
+
+namespace {
+
+using namespace std;
+using namespace mjkgb;
+
+class JoypadTest : public testing::Test {
+protected:
+    GameboyImpl gb;
+
+    uint8_t flags()
+    {
+        return gb.mmu_.get(GameboyImpl::interrupt_flag_address);
+    }
+};
+
+TEST_F(JoypadTest, Register) {
+    gb.joypad_.set_buttons(gb, Gameboy::RIGHT | Gameboy::UP | Gameboy::START);
+    EXPECT_EQ(0xff, gb.mmu_.get(Joypad::joyp_address));
+
+    /* Directions */
+    gb.mmu_.set(Joypad::joyp_address, 0x20);
+    EXPECT_EQ(0xea, gb.mmu_.get(Joypad::joyp_address));
+
+    /* Buttons */
+    gb.mmu_.set(Joypad::joyp_address, 0x10);
+    EXPECT_EQ(0xd7, gb.mmu_.get(Joypad::joyp_address));
+
+    /* Both */
+    gb.mmu_.set(Joypad::joyp_address, 0x00);
+    EXPECT_EQ(0xc2, gb.mmu_.get(Joypad::joyp_address));
+}
+
+TEST_F(JoypadTest, Interrupt) {
+    gb.mmu_.set(GameboyImpl::interrupt_flag_address, 0);
+    gb.mmu_.set(Joypad::joyp_address, 0x20);
+
+    /* Only selected lines going low count */
+    gb.joypad_.set_buttons(gb, Gameboy::A);
+    EXPECT_EQ(0, flags() & 0x10);
+    gb.joypad_.set_buttons(gb, Gameboy::A | Gameboy::LEFT);
+    EXPECT_EQ(0x10, flags() & 0x10);
+
+    gb.mmu_.set(GameboyImpl::interrupt_flag_address, 0);
+    gb.joypad_.set_buttons(gb, 0);
+    EXPECT_EQ(0, flags() & 0x10);
+
+    /* As does selecting a line which is already held */
+    gb.joypad_.set_buttons(gb, Gameboy::B);
+    gb.mmu_.set(Joypad::joyp_address, 0x10);
+    EXPECT_EQ(0x10, flags() & 0x10);
+}
+
+TEST_F(JoypadTest, Queue) {
+    /* loop: JR loop */
+    stringstream code{string{"\x18\xfe", 2}};
+    gb.load(code);
+
+    auto frame = Lcd::vblank_line * Lcd::cycles_per_line;
+    gb.joypad_.queue(gb, frame + Lcd::cycles_per_frame, Gameboy::B);
+    gb.joypad_.queue(gb, frame, Gameboy::A);
+    gb.joypad_.queue(gb, frame, Gameboy::A | Gameboy::DOWN);
+    EXPECT_EQ(frame, gb.scheduler_.deadline(Event::INPUT));
+
+    gb.run_until(frame - 1);
+    EXPECT_EQ(0, gb.joypad_.buttons());
+
+    /* Changes are applied in order by the time the frame is returned */
+    gb.run_frame();
+    EXPECT_EQ(Gameboy::A | Gameboy::DOWN, gb.joypad_.buttons());
+    gb.run_frame();
+    EXPECT_EQ(Gameboy::B, gb.joypad_.buttons());
+    EXPECT_FALSE(gb.joypad_.queued());
+    EXPECT_EQ(Scheduler::never, gb.scheduler_.deadline(Event::INPUT));
+
+    /* Loading a state drops anything queued but keeps what is held */
+    vector<uint8_t> state(gb.state_size());
+    StateWriter writer{state.data(), state.size()};
+    gb.save_state(writer, Mmu::all_pages());
+
+    gb.joypad_.queue(gb, gb.cpu_.get_clock() + 100, Gameboy::START);
+    StateReader reader{state.data(), state.size()};
+    EXPECT_TRUE(gb.load_state(reader));
+    EXPECT_FALSE(gb.joypad_.queued());
+    EXPECT_EQ(Scheduler::never, gb.scheduler_.deadline(Event::INPUT));
+    EXPECT_EQ(Gameboy::B, gb.joypad_.buttons());
+}
+
+}
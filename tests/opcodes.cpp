@@ -42,25 +42,25 @@ TEST_F(OpcodesTest, EightBitLoads) {
     gb.load(code2);
 
     gb.set(WordRegister::PC, 0);
-    gb.set(WordRegister::HL, 0xff00);
+    gb.set(WordRegister::HL, 0xff80);
     gb.set(ByteRegister::A, 0);
-    gb.set(byte_ptr(Constant<0xff00>{}), 0x42);
+    gb.set(byte_ptr(Constant<0xff80>{}), 0x42);
     gb.run();
 
     EXPECT_EQ(0x42, gb.get(ByteRegister::A));
-    EXPECT_EQ(0x42, gb.get(byte_ptr(Constant<0xff00>{})));
+    EXPECT_EQ(0x42, gb.get(byte_ptr(Constant<0xff80>{})));
 
     /* LD (HL), A; STOP */
     stringstream code3{string{"\x77\x10\x00", 3}};
     gb.load(code3);
 
     gb.set(WordRegister::PC, 0);
-    gb.set(WordRegister::HL, 0xff00);
+    gb.set(WordRegister::HL, 0xff80);
     gb.set(ByteRegister::A, 0x42);
-    gb.set(byte_ptr(Constant<0xff00>{}), 0);
+    gb.set(byte_ptr(Constant<0xff80>{}), 0);
     gb.run();
 
-    EXPECT_EQ(0x42, gb.get(byte_ptr(Constant<0xff00>{})));
+    EXPECT_EQ(0x42, gb.get(byte_ptr(Constant<0xff80>{})));
     EXPECT_EQ(0x42, gb.get(ByteRegister::A));
 
     /* LD (HL), n; STOP */
@@ -68,11 +68,11 @@ TEST_F(OpcodesTest, EightBitLoads) {
     gb.load(code4);
 
     gb.set(WordRegister::PC, 0);
-    gb.set(WordRegister::HL, 0xff00);
-    gb.set(byte_ptr(Constant<0xff00>{}), 0);
+    gb.set(WordRegister::HL, 0xff80);
+    gb.set(byte_ptr(Constant<0xff80>{}), 0);
     gb.run();
 
-    EXPECT_EQ(0x42, gb.get(byte_ptr(Constant<0xff00>{})));
+    EXPECT_EQ(0x42, gb.get(byte_ptr(Constant<0xff80>{})));
 
     /* LD A, (BC); STOP */
     stringstream code5{string{"\x0a\x10\x00", 3}};
@@ -80,48 +80,48 @@ TEST_F(OpcodesTest, EightBitLoads) {
 
     gb.set(WordRegister::PC, 0);
     gb.set(ByteRegister::A, 0);
-    gb.set(WordRegister::BC, 0xff00);
-    gb.set(byte_ptr(Constant<0xff00>{}), 0x42);
+    gb.set(WordRegister::BC, 0xff80);
+    gb.set(byte_ptr(Constant<0xff80>{}), 0x42);
     gb.run();
 
     EXPECT_EQ(0x42, gb.get(ByteRegister::A));
-    EXPECT_EQ(0x42, gb.get(byte_ptr(Constant<0xff00>{})));
+    EXPECT_EQ(0x42, gb.get(byte_ptr(Constant<0xff80>{})));
 
     /* LD A, (nn); STOP */
-    stringstream code6{string{"\xfa\x00\xff\x10\x00", 5}};
+    stringstream code6{string{"\xfa\x80\xff\x10\x00", 5}};
     gb.load(code6);
 
     gb.set(WordRegister::PC, 0);
     gb.set(ByteRegister::A, 0);
-    gb.set(byte_ptr(Constant<0xff00>{}), 0x42);
+    gb.set(byte_ptr(Constant<0xff80>{}), 0x42);
     gb.run();
 
     EXPECT_EQ(0x42, gb.get(ByteRegister::A));
-    EXPECT_EQ(0x42, gb.get(byte_ptr(Constant<0xff00>{})));
+    EXPECT_EQ(0x42, gb.get(byte_ptr(Constant<0xff80>{})));
 
     /* LD (BC), A; STOP */
     stringstream code7{string{"\x02\x10\x00", 3}};
     gb.load(code7);
 
     gb.set(WordRegister::PC, 0);
-    gb.set(WordRegister::BC, 0xff00);
+    gb.set(WordRegister::BC, 0xff80);
     gb.set(ByteRegister::A, 0x42);
-    gb.set(byte_ptr(Constant<0xff00>{}), 0);
+    gb.set(byte_ptr(Constant<0xff80>{}), 0);
     gb.run();
 
-    EXPECT_EQ(0x42, gb.get(byte_ptr(Constant<0xff00>{})));
+    EXPECT_EQ(0x42, gb.get(byte_ptr(Constant<0xff80>{})));
     EXPECT_EQ(0x42, gb.get(ByteRegister::A));
 
     /* LD A, (nn); STOP */
-    stringstream code8{string{"\xea\x00\xff\x10\x00", 5}};
+    stringstream code8{string{"\xea\x80\xff\x10\x00", 5}};
     gb.load(code8);
 
     gb.set(WordRegister::PC, 0);
     gb.set(ByteRegister::A, 0x42);
-    gb.set(byte_ptr(Constant<0xff00>{}), 0);
+    gb.set(byte_ptr(Constant<0xff80>{}), 0);
     gb.run();
 
-    EXPECT_EQ(0x42, gb.get(byte_ptr(Constant<0xff00>{})));
+    EXPECT_EQ(0x42, gb.get(byte_ptr(Constant<0xff80>{})));
     EXPECT_EQ(0x42, gb.get(ByteRegister::A));
 
     /* LD A, (C); STOP */
@@ -129,13 +129,13 @@ TEST_F(OpcodesTest, EightBitLoads) {
     gb.load(code9);
 
     gb.set(WordRegister::PC, 0);
-    gb.set(ByteRegister::C, 0);
+    gb.set(ByteRegister::C, 0x80);
     gb.set(ByteRegister::A, 0);
-    gb.set(byte_ptr(Constant<0xff00>{}), 0x42);
+    gb.set(byte_ptr(Constant<0xff80>{}), 0x42);
     gb.run();
 
     EXPECT_EQ(0x42, gb.get(ByteRegister::A));
-    EXPECT_EQ(0x42, gb.get(byte_ptr(Constant<0xff00>{})));
+    EXPECT_EQ(0x42, gb.get(byte_ptr(Constant<0xff80>{})));
 
     /* LD (C), A; STOP */
     stringstream code10{string{"\xe2\x10\x00", 3}};
@@ -143,11 +143,11 @@ TEST_F(OpcodesTest, EightBitLoads) {
 
     gb.set(WordRegister::PC, 0);
     gb.set(ByteRegister::A, 0x42);
-    gb.set(ByteRegister::C, 0);
-    gb.set(byte_ptr(Constant<0xff00>{}), 0);
+    gb.set(ByteRegister::C, 0x80);
+    gb.set(byte_ptr(Constant<0xff80>{}), 0);
     gb.run();
 
-    EXPECT_EQ(0x42, gb.get(byte_ptr(Constant<0xff00>{})));
+    EXPECT_EQ(0x42, gb.get(byte_ptr(Constant<0xff80>{})));
     EXPECT_EQ(0x42, gb.get(ByteRegister::A));
 
     /* LDI A, (HL); STOP */
@@ -156,13 +156,13 @@ TEST_F(OpcodesTest, EightBitLoads) {
 
     gb.set(WordRegister::PC, 0);
     gb.set(ByteRegister::A, 0);
-    gb.set(WordRegister::HL, 0xff00);
-    gb.set(byte_ptr(Constant<0xff00>{}), 0x42);
+    gb.set(WordRegister::HL, 0xff80);
+    gb.set(byte_ptr(Constant<0xff80>{}), 0x42);
     gb.run();
 
     EXPECT_EQ(0x42, gb.get(ByteRegister::A));
-    EXPECT_EQ(0x42, gb.get(byte_ptr(Constant<0xff00>{})));
-    EXPECT_EQ(0xff01, gb.get(WordRegister::HL));
+    EXPECT_EQ(0x42, gb.get(byte_ptr(Constant<0xff80>{})));
+    EXPECT_EQ(0xff81, gb.get(WordRegister::HL));
 
     /* LDI (HL), A; STOP */
     stringstream code12{string{"\x22\x10\x00", 3}};
@@ -170,13 +170,13 @@ TEST_F(OpcodesTest, EightBitLoads) {
 
     gb.set(WordRegister::PC, 0);
     gb.set(ByteRegister::A, 0x42);
-    gb.set(WordRegister::HL, 0xff00);
-    gb.set(byte_ptr(Constant<0xff00>{}), 0x0);
+    gb.set(WordRegister::HL, 0xff80);
+    gb.set(byte_ptr(Constant<0xff80>{}), 0x0);
     gb.run();
 
-    EXPECT_EQ(0x42, gb.get(byte_ptr(Constant<0xff00>{})));
+    EXPECT_EQ(0x42, gb.get(byte_ptr(Constant<0xff80>{})));
     EXPECT_EQ(0x42, gb.get(ByteRegister::A));
-    EXPECT_EQ(0xff01, gb.get(WordRegister::HL));
+    EXPECT_EQ(0xff81, gb.get(WordRegister::HL));
 
     /* LDD A, (HL); STOP */
     stringstream code13{string{"\x3a\x10\x00", 3}};
@@ -184,13 +184,13 @@ TEST_F(OpcodesTest, EightBitLoads) {
 
     gb.set(WordRegister::PC, 0);
     gb.set(ByteRegister::A, 0);
-    gb.set(WordRegister::HL, 0xff00);
-    gb.set(byte_ptr(Constant<0xff00>{}), 0x42);
+    gb.set(WordRegister::HL, 0xff80);
+    gb.set(byte_ptr(Constant<0xff80>{}), 0x42);
     gb.run();
 
     EXPECT_EQ(0x42, gb.get(ByteRegister::A));
-    EXPECT_EQ(0x42, gb.get(byte_ptr(Constant<0xff00>{})));
-    EXPECT_EQ(0xfeff, gb.get(WordRegister::HL));
+    EXPECT_EQ(0x42, gb.get(byte_ptr(Constant<0xff80>{})));
+    EXPECT_EQ(0xff7f, gb.get(WordRegister::HL));
 
     /* LDD (HL), A; STOP */
     stringstream code14{string{"\x32\x10\x00", 3}};
@@ -198,36 +198,36 @@ TEST_F(OpcodesTest, EightBitLoads) {
 
     gb.set(WordRegister::PC, 0);
     gb.set(ByteRegister::A, 0x42);
-    gb.set(WordRegister::HL, 0xff00);
-    gb.set(byte_ptr(Constant<0xff00>{}), 0x0);
+    gb.set(WordRegister::HL, 0xff80);
+    gb.set(byte_ptr(Constant<0xff80>{}), 0x0);
     gb.run();
 
-    EXPECT_EQ(0x42, gb.get(byte_ptr(Constant<0xff00>{})));
+    EXPECT_EQ(0x42, gb.get(byte_ptr(Constant<0xff80>{})));
     EXPECT_EQ(0x42, gb.get(ByteRegister::A));
-    EXPECT_EQ(0xfeff, gb.get(WordRegister::HL));
+    EXPECT_EQ(0xff7f, gb.get(WordRegister::HL));
 
     /* LDH A, (n); STOP */
-    stringstream code15{string{"\xf0\x00\x10\x00", 4}};
+    stringstream code15{string{"\xf0\x80\x10\x00", 4}};
     gb.load(code15);
 
     gb.set(WordRegister::PC, 0);
     gb.set(ByteRegister::A, 0);
-    gb.set(byte_ptr(Constant<0xff00>{}), 0x42);
+    gb.set(byte_ptr(Constant<0xff80>{}), 0x42);
     gb.run();
 
     EXPECT_EQ(0x42, gb.get(ByteRegister::A));
-    EXPECT_EQ(0x42, gb.get(byte_ptr(Constant<0xff00>{})));
+    EXPECT_EQ(0x42, gb.get(byte_ptr(Constant<0xff80>{})));
 
     /* LDH (n), A; STOP */
-    stringstream code16{string{"\xe0\x00\x10\x00", 4}};
+    stringstream code16{string{"\xe0\x80\x10\x00", 4}};
     gb.load(code16);
 
     gb.set(WordRegister::PC, 0);
     gb.set(ByteRegister::A, 0x42);
-    gb.set(byte_ptr(Constant<0xff00>{}), 0);
+    gb.set(byte_ptr(Constant<0xff80>{}), 0);
     gb.run();
 
-    EXPECT_EQ(0x42, gb.get(byte_ptr(Constant<0xff00>{})));
+    EXPECT_EQ(0x42, gb.get(byte_ptr(Constant<0xff80>{})));
     EXPECT_EQ(0x42, gb.get(ByteRegister::A));
 }
 
@@ -243,15 +243,15 @@ TEST_F(OpcodesTest, SixteenBitLoads) {
     EXPECT_EQ(0xbeef, gb.get(WordRegister::BC));
 
     /* LD (nn), SP; STOP */
-    stringstream code1{string{"\x08\x00\xff\x10\x00", 5}};
+    stringstream code1{string{"\x08\x80\xff\x10\x00", 5}};
     gb.load(code1);
 
     gb.set(WordRegister::PC, 0);
     gb.set(WordRegister::SP, 0xbeef);
-    gb.set(word_ptr(Constant<0xff00>{}), 0);
+    gb.set(word_ptr(Constant<0xff80>{}), 0);
     gb.run();
 
-    EXPECT_EQ(0xbeef, gb.get(word_ptr(Constant<0xff00>{})));
+    EXPECT_EQ(0xbeef, gb.get(word_ptr(Constant<0xff80>{})));
     EXPECT_EQ(0xbeef, gb.get(WordRegister::SP));
 
     /* LD SP, HL; STOP */
@@ -306,5 +306,18 @@ TEST_F(OpcodesTest, SixteenBitLoads) {
     EXPECT_EQ(0xff00, gb.get(WordRegister::SP));
 }
 
+TEST_F(OpcodesTest, RomWritesIgnored) {
+    /* LD (0x0001), A; STOP */
+    stringstream code{string{"\xea\x01\x00\x10\x00", 5}};
+    gb.load(code);
+    gb.mmu_.clean();
+
+    gb.set(WordRegister::PC, 0);
+    gb.set(ByteRegister::A, 0x42);
+    gb.run();
+
+    EXPECT_EQ(0x01, gb.mmu_.peek(0x0001));
+    EXPECT_EQ(0, Mmu::count(gb.mmu_.dirty()));
 }
 
+}
@@ -0,0 +1,138 @@
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <vector>
+
+#include <elf.h>
+#include <gtest/gtest.h>
+#include <link.h>
+#include <unistd.h>
+
+#include "perf_map.hpp"
+
+namespace {
+
+using namespace std;
+using namespace mjkgb;
+
+class PerfMapTest : public testing::Test {
+protected:
+    void SetUp() override
+    {
+        ASSERT_NE(nullptr, mkdtemp(directory));
+        map_path = string{directory} + "/perf.map";
+        dump_path = string{directory} + "/jit.dump";
+    }
+
+    void TearDown() override
+    {
+        unlink(map_path.c_str());
+        unlink(dump_path.c_str());
+        rmdir(directory);
+    }
+
+    char directory[32] = "/tmp/mjkgb-perf-XXXXXX";
+    string map_path;
+    string dump_path;
+};
+
+template<typename T>
+T field(const vector<uint8_t> &data, size_t offset)
+{
+    T value;
+    memcpy(&value, &data[offset], sizeof(T));
+    return value;
+}
+
+TEST_F(PerfMapTest, Map) {
+    {
+        PerfMap perf{map_path, ""};
+        perf.add(0x1000, 0x20, "gb.baseline 00:0150 nop jp_nn");
+        perf.add(0xabcdef, 0x8, "nop");
+    }
+
+    ifstream map{map_path};
+    stringstream lines;
+    lines << map.rdbuf();
+    EXPECT_EQ("1000 20 gb.baseline 00:0150 nop jp_nn\nabcdef 8 nop\n", lines.str());
+
+    ifstream dump{dump_path};
+    EXPECT_FALSE(dump.is_open());
+}
+
+TEST_F(PerfMapTest, Dump) {
+    const uint8_t code[] = { 0xc3, 0x90, 0x90 };
+    {
+        PerfMap perf{map_path, dump_path};
+        perf.add(reinterpret_cast<uintptr_t>(code), sizeof(code), "gb");
+        perf.add(reinterpret_cast<uintptr_t>(code), 1, "");
+    }
+
+    ifstream file{dump_path, ios::binary};
+    vector<uint8_t> dump{istreambuf_iterator<char>{file}, istreambuf_iterator<char>{}};
+    ASSERT_EQ(40u + 56 + 3 + 3 + 56 + 1 + 1, dump.size());
+
+    /* Header */
+    EXPECT_EQ(0x4a695444u, field<uint32_t>(dump, 0));
+    EXPECT_EQ(1u, field<uint32_t>(dump, 4));
+    EXPECT_EQ(40u, field<uint32_t>(dump, 8));
+    EXPECT_EQ(static_cast<uint32_t>(getpid()), field<uint32_t>(dump, 20));
+
+    /* Code load records, with the name and then a copy of the code */
+    EXPECT_EQ(0u, field<uint32_t>(dump, 40));
+    EXPECT_EQ(56u + 3 + 3, field<uint32_t>(dump, 44));
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(code), field<uint64_t>(dump, 64));
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(code), field<uint64_t>(dump, 72));
+    EXPECT_EQ(3u, field<uint64_t>(dump, 80));
+    EXPECT_EQ(0u, field<uint64_t>(dump, 88));
+    EXPECT_EQ(0, memcmp("gb", &dump[96], 3));
+    EXPECT_EQ(0, memcmp(code, &dump[99], 3));
+
+    EXPECT_GT(field<uint64_t>(dump, 102 + 8), 0u);
+    EXPECT_EQ(1u, field<uint64_t>(dump, 102 + 48));
+
+    EXPECT_EQ(nullptr, PerfMap::get());
+}
+
+TEST_F(PerfMapTest, Gdb) {
+    const uint8_t code[] = { 0xc3, 0x90, 0x90 };
+    auto first = __jit_debug_descriptor.first_entry;
+    {
+        GdbEntry entry{reinterpret_cast<uintptr_t>(code), sizeof(code), "gb.baseline 00:0150 nop"};
+        GdbEntry other{0x1000, 1, "other"};
+
+        /* Newest first, and announced as it's added */
+        auto listed = __jit_debug_descriptor.first_entry;
+        ASSERT_NE(nullptr, listed);
+        EXPECT_EQ(listed, __jit_debug_descriptor.relevant_entry);
+        EXPECT_EQ(static_cast<uint32_t>(JIT_REGISTER_FN), __jit_debug_descriptor.action_flag);
+        EXPECT_EQ(other.symfile().data(), listed->symfile_addr);
+        ASSERT_NE(nullptr, listed->next_entry);
+        EXPECT_EQ(entry.symfile().data(), listed->next_entry->symfile_addr);
+        EXPECT_EQ(entry.symfile().size(), listed->next_entry->symfile_size);
+        EXPECT_EQ(first, listed->next_entry->next_entry);
+
+        /* An object with a section at the code and a symbol covering it */
+        const auto &symfile = entry.symfile();
+        auto header = reinterpret_cast<const ElfW(Ehdr) *>(symfile.data());
+        EXPECT_EQ(0, memcmp(ELFMAG, header->e_ident, SELFMAG));
+        auto sections = reinterpret_cast<const ElfW(Shdr) *>(symfile.data() + header->e_shoff);
+        EXPECT_EQ(reinterpret_cast<uintptr_t>(code), sections[1].sh_addr);
+        ASSERT_EQ(static_cast<unsigned>(SHT_SYMTAB), sections[2].sh_type);
+        auto symbol = reinterpret_cast<const ElfW(Sym) *>(symfile.data() + sections[2].sh_offset) + 1;
+        EXPECT_EQ(sizeof(code), symbol->st_size);
+        EXPECT_EQ(0u, symbol->st_value);
+        auto strings = symfile.data() + sections[sections[2].sh_link].sh_offset;
+        EXPECT_STREQ("gb.baseline 00:0150 nop", strings + symbol->st_name);
+        auto names = symfile.data() + sections[header->e_shstrndx].sh_offset;
+        EXPECT_STREQ(".text", names + sections[1].sh_name);
+    }
+
+    /* Both gone again */
+    EXPECT_EQ(first, __jit_debug_descriptor.first_entry);
+    EXPECT_EQ(static_cast<uint32_t>(JIT_UNREGISTER_FN), __jit_debug_descriptor.action_flag);
+}
+
+}
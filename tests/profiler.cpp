@@ -0,0 +1,96 @@
+#include <cstdio>
+#include <sstream>
+
+#include <gtest/gtest.h>
+
+#include "gameboy_impl.hpp"
+
+namespace {
+
+using namespace std;
+using namespace mjkgb;
+
+TEST(ProfilerTest, Collapsed) {
+    Profiler profiler;
+    profiler.start(100, 50);
+    EXPECT_EQ(100u, profiler.period());
+    EXPECT_EQ(150u, profiler.due());
+
+    profiler.sample(0x0150);
+    profiler.call(0x4000, 0xfffc);
+    profiler.sample(0x4002);
+    profiler.sample(0x4002);
+    profiler.call(0x0200, 0xfffa);
+    profiler.sample(0x0201);
+    profiler.ret(0xfffa);
+    profiler.sample(0x4005);
+    profiler.ret(0xfffc);
+    profiler.sample(0x0153);
+    EXPECT_EQ(750u, profiler.due());
+
+    EXPECT_EQ("00:0150 1\n"
+            "00:0153 1\n"
+            "01:4000;00:0200;00:0201 1\n"
+            "01:4000;01:4002 2\n"
+            "01:4000;01:4005 1\n", profiler.collapsed());
+
+    profiler.stop();
+    EXPECT_EQ(0u, profiler.period());
+    profiler.start(10, 1000);
+    EXPECT_EQ("", profiler.collapsed());
+}
+
+TEST(ProfilerTest, Unwinds) {
+    Profiler profiler;
+    profiler.start(100, 0);
+
+    /* Returning past frames the guest dropped by moving SP drops them too */
+    profiler.call(0x1000, 0xfffc);
+    profiler.call(0x2000, 0xfffa);
+    profiler.call(0x3000, 0xfff8);
+    profiler.ret(0xfffc);
+    profiler.sample(0x0100);
+
+    /* Beyond the maximum depth only the innermost calls are kept */
+    for (uint16_t i = 0; i < Profiler::max_depth + 2; ++i)
+        profiler.call(i, static_cast<uint16_t>(0xfffe - 2 * i));
+    profiler.sample(0x0200);
+
+    string deep;
+    for (unsigned i = 2; i < Profiler::max_depth + 2; ++i) {
+        char frame[9];
+        snprintf(frame, sizeof(frame), "00:%04x;", i);
+        deep += frame;
+    }
+    EXPECT_EQ(deep + "00:0200 1\n00:0100 1\n", profiler.collapsed());
+}
+
+TEST(ProfilerTest, Machine) {
+    /* LD SP, 0xdffe; CALL 0x0010; 0x0010: NOP; NOP; JR 0x0010 */
+    string code{"\x31\xfe\xdf\xcd\x10\x00", 6};
+    code.resize(0x10);
+    code += string{"\x00\x00\x18\xfc", 4};
+    stringstream stream{code};
+
+    Gameboy gb;
+    gb.load(stream);
+
+#ifdef MJKGB_PROFILER
+    ASSERT_TRUE(gb.startProfiling(7));
+    gb.runCycles(7000);
+    auto profile = gb.profile();
+    auto lines = "\n" + profile;
+    EXPECT_NE(string::npos, lines.find("\n00:0010;00:0010 "));
+    EXPECT_NE(string::npos, lines.find("\n00:0010;00:0011 "));
+    EXPECT_NE(string::npos, lines.find("\n00:0010;00:0012 "));
+
+    gb.stopProfiling();
+    gb.runCycles(7000);
+    EXPECT_EQ(profile, gb.profile());
+#else
+    EXPECT_FALSE(gb.startProfiling(7));
+    EXPECT_EQ("", gb.profile());
+#endif
+}
+
+}
@@ -0,0 +1,96 @@
+#include <cstdlib>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "gameboy_impl.hpp"
+
+namespace {
+
+using namespace std;
+using namespace mjkgb;
+
+class RewindTest : public testing::Test {
+protected:
+    void run_frames(int frames)
+    {
+        for (auto i = 0; i < frames; ++i) {
+            gb.mmu_.set(0xc000, static_cast<uint8_t>(next_++));
+            gb.cpu_.skip(Lcd::cycles_per_frame);
+            gb.scheduler_.dispatch(gb, gb.cpu_.get_clock());
+        }
+    }
+
+    GameboyImpl gb;
+    int next_ = 0;
+};
+
+TEST_F(RewindTest, Encode) {
+    vector<uint8_t> from(1000), to(1000);
+    for (size_t i = 0; i < from.size(); ++i) {
+        from[i] = static_cast<uint8_t>(rand());
+        to[i] = i % 100 < 10 ? static_cast<uint8_t>(rand()) : from[i];
+    }
+
+    vector<uint8_t> delta;
+    Rewind::encode(from.data(), to.data(), from.size(), delta);
+    EXPECT_GT(from.size() / 4, delta.size());
+
+    Rewind::apply(delta, from.data());
+    EXPECT_EQ(to, from);
+}
+
+TEST_F(RewindTest, StepBack) {
+    gb.rewind_.reset(new Rewind{1 << 20});
+    run_frames(10);
+    EXPECT_EQ(9u, gb.rewind_->frames());
+
+    auto clock = gb.cpu_.get_clock();
+    ASSERT_TRUE(gb.rewind_->rewind(gb, 3));
+    EXPECT_EQ(6, gb.mmu_.get(0xc000));
+    EXPECT_EQ(6u, gb.rewind_->frames());
+    EXPECT_GT(clock, gb.cpu_.get_clock());
+
+    EXPECT_FALSE(gb.rewind_->rewind(gb, 7));
+    EXPECT_EQ(6, gb.mmu_.get(0xc000));
+
+    /* History continues from the restored frame */
+    run_frames(2);
+    EXPECT_EQ(8u, gb.rewind_->frames());
+    ASSERT_TRUE(gb.rewind_->rewind(gb, 8));
+    EXPECT_EQ(0, gb.mmu_.get(0xc000));
+}
+
+TEST_F(RewindTest, DeltaAfterRewind) {
+    gb.rewind_.reset(new Rewind{1 << 20});
+    run_frames(2);
+    vector<uint8_t> parent(gb.state_size());
+    ASSERT_NE(0u, gb.save_snapshot(parent.data(), parent.size(), false));
+
+    gb.mmu_.set(0xd000, 0x01);
+    run_frames(3);
+    ASSERT_TRUE(gb.rewind_->rewind(gb, 1));
+
+    /* Nothing has been written since rewinding, but memory no longer
+     * matches the parent
+     */
+    vector<uint8_t> delta(gb.state_size());
+    EXPECT_EQ(gb.state_size(), gb.save_snapshot(delta.data(), delta.size(), true));
+
+    StateReader reader{parent.data(), parent.size()};
+    ASSERT_TRUE(gb.load_state(reader));
+    EXPECT_EQ(0x00, gb.mmu_.get(0xd000));
+    StateReader delta_reader{delta.data(), delta.size()};
+    ASSERT_TRUE(gb.load_state(delta_reader));
+    EXPECT_EQ(0x01, gb.mmu_.get(0xd000));
+}
+
+TEST_F(RewindTest, Budget) {
+    gb.rewind_.reset(new Rewind{gb.state_size() + 1000});
+    run_frames(100);
+    EXPECT_GE(gb.state_size() + 1000, gb.rewind_->used());
+    EXPECT_LT(0u, gb.rewind_->frames());
+    EXPECT_GT(99u, gb.rewind_->frames());
+}
+
+}
@@ -0,0 +1,209 @@
+#include <sstream>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "gameboy_impl.hpp"
+
+namespace {
+
+using namespace std;
+using namespace mjkgb;
+
+class StateTest : public testing::Test {
+protected:
+    vector<uint8_t> save(bool delta = false)
+    {
+        vector<uint8_t> buffer(gb.state_size());
+        buffer.resize(gb.save_snapshot(buffer.data(), buffer.size(), delta));
+        EXPECT_FALSE(buffer.empty());
+        return buffer;
+    }
+
+    bool load(const vector<uint8_t> &buffer)
+    {
+        StateReader state{buffer.data(), buffer.size()};
+        return gb.load_state(state);
+    }
+
+    void advance(unsigned long cycles)
+    {
+        gb.cpu_.skip(cycles);
+        gb.scheduler_.dispatch(gb, gb.cpu_.get_clock());
+    }
+
+    GameboyImpl gb;
+};
+
+TEST_F(StateTest, RoundTrip) {
+    gb.cpu_.set(WordRegister::BC, 0x1234, false);
+    gb.cpu_.set(WordRegister::SP, 0xfffe, false);
+    gb.mmu_.set(0xc000, 0x42);
+    gb.mmu_.set(Timer::tac_address, 0x05);
+    gb.mmu_.set(Dma::dma_address, 0xc0);
+    advance(100);
+
+    auto state = save();
+    auto clock = gb.cpu_.get_clock();
+    auto tima = gb.mmu_.get(Timer::tima_address);
+
+    gb.cpu_.set(WordRegister::BC, 0, false);
+    gb.mmu_.set(0xff80, 0x99);
+    advance(1000);
+    EXPECT_FALSE(gb.dma_.active());
+
+    ASSERT_TRUE(load(state));
+    EXPECT_EQ(clock, gb.cpu_.get_clock());
+    EXPECT_EQ(0x1234, gb.cpu_.get(WordRegister::BC));
+    EXPECT_EQ(0xfffe, gb.cpu_.get(WordRegister::SP));
+    EXPECT_EQ(0x00, gb.mmu_.peek(0xff80));
+    EXPECT_EQ(tima, gb.mmu_.get(Timer::tima_address));
+
+    /* The transfer is still in progress, and finishes on time */
+    EXPECT_TRUE(gb.dma_.active());
+    EXPECT_EQ(0xff, gb.mmu_.get(0xc000));
+    advance(Dma::transfer_cycles - 100);
+    EXPECT_FALSE(gb.dma_.active());
+    EXPECT_EQ(0x42, gb.mmu_.get(0xc000));
+
+    EXPECT_EQ(gb.state_size(), save().size());
+}
+
+TEST_F(StateTest, Delta) {
+    auto parent = save();
+
+    gb.mmu_.set(0xc000, 0x42);
+    gb.mmu_.set(0xd080, 0x43);
+    gb.cpu_.set(WordRegister::BC, 0x1234, false);
+    EXPECT_EQ(2, Mmu::count(gb.mmu_.dirty()));
+
+    auto delta = save(true);
+    EXPECT_EQ(parent.size() - (Mmu::num_pages - 2) * Mmu::page_size, delta.size());
+    EXPECT_EQ(0, Mmu::count(gb.mmu_.dirty()));
+
+    gb.mmu_.set(0xc000, 0);
+    gb.mmu_.set(0xd080, 0);
+    ASSERT_TRUE(load(parent));
+    EXPECT_EQ(0, gb.cpu_.get(WordRegister::BC));
+    ASSERT_TRUE(load(delta));
+    EXPECT_EQ(0x42, gb.mmu_.get(0xc000));
+    EXPECT_EQ(0x43, gb.mmu_.get(0xd080));
+    EXPECT_EQ(0x1234, gb.cpu_.get(WordRegister::BC));
+    EXPECT_EQ(0, Mmu::count(gb.mmu_.dirty()));
+
+    /* OAM DMA writes count too */
+    gb.mmu_.set(Dma::dma_address, 0xc0);
+    EXPECT_TRUE(Mmu::contains(gb.mmu_.dirty(), Dma::oam_address >> 8));
+}
+
+TEST_F(StateTest, DeltaNeedsParent) {
+    auto parent = save();
+    gb.mmu_.set(0xc000, 0x42);
+    auto delta = save(true);
+
+    /* Written to memory since the parent was loaded */
+    ASSERT_TRUE(load(parent));
+    gb.mmu_.set(0xd000, 0x01);
+    EXPECT_FALSE(load(delta));
+    EXPECT_EQ(0x00, gb.mmu_.get(0xc000));
+
+    /* At another state */
+    auto other = save();
+    EXPECT_FALSE(load(delta));
+    EXPECT_EQ(0x00, gb.mmu_.get(0xc000));
+
+    /* A machine which never saw the parent */
+    GameboyImpl fresh;
+    StateReader state{delta.data(), delta.size()};
+    EXPECT_FALSE(fresh.load_state(state));
+
+    ASSERT_TRUE(load(parent));
+    ASSERT_TRUE(load(delta));
+    EXPECT_EQ(0x42, gb.mmu_.get(0xc000));
+    EXPECT_EQ(0x00, gb.mmu_.get(0xd000));
+
+    /* Deltas chain, each on top of the last */
+    gb.mmu_.set(0xc001, 0x43);
+    auto next = save(true);
+    ASSERT_TRUE(load(other));
+    EXPECT_FALSE(load(next));
+    ASSERT_TRUE(load(parent));
+    ASSERT_TRUE(load(delta));
+    ASSERT_TRUE(load(next));
+    EXPECT_EQ(0x43, gb.mmu_.get(0xc001));
+
+    /* Without a parent, a delta holds everything */
+    stringstream rom{""};
+    gb.load(rom);
+    EXPECT_EQ(gb.state_size(), save(true).size());
+}
+
+TEST_F(StateTest, Rejected) {
+    auto state = save();
+    gb.cpu_.set(WordRegister::BC, 0x1234, false);
+
+    EXPECT_FALSE(load(vector<uint8_t>(state.begin(), state.end() - 1)));
+    state[4] ^= 0xff;
+    EXPECT_FALSE(load(state));
+    EXPECT_EQ(0x1234, gb.cpu_.get(WordRegister::BC));
+}
+
+TEST_F(StateTest, NativeCodeKept) {
+    gb.mmu_.set_native(0x0150, 1);
+    gb.mmu_.set_native(0x01fe, 2);
+    auto state = save();
+
+    gb.mmu_.set(0xc080, 0x01);
+    ASSERT_TRUE(load(state));
+    EXPECT_EQ(1u, gb.mmu_.get_native(0x0150));
+    EXPECT_EQ(2u, gb.mmu_.get_native(0x01fe));
+
+    /* The block at 0x01fe runs on into the changed page, and a trace from
+     * 0x0150 could have too
+     */
+    gb.mmu_.poke(0x0200, 0x01);
+    ASSERT_TRUE(load(state));
+    EXPECT_EQ(0u, gb.mmu_.get_native(0x0150));
+    EXPECT_EQ(0u, gb.mmu_.get_native(0x01fe));
+}
+
+TEST_F(StateTest, Clone) {
+    gb.cpu_.set(WordRegister::BC, 0x1234, false);
+    gb.mmu_.set(0xc000, 0x42);
+    gb.mmu_.set_native(0x0150, 1);
+    advance(100);
+
+    GameboyImpl copy{gb};
+    EXPECT_EQ(gb.cpu_.get_clock(), copy.cpu_.get_clock());
+    EXPECT_EQ(0x1234, copy.cpu_.get(WordRegister::BC));
+    EXPECT_EQ(0x42, copy.mmu_.get(0xc000));
+    EXPECT_EQ(1u, copy.mmu_.get_native(0x0150));
+
+    /* Neither side sees the other's changes to the machine */
+    copy.mmu_.set(0xc000, 0x43);
+    gb.cpu_.set(WordRegister::BC, 0, false);
+    EXPECT_EQ(0x42, gb.mmu_.get(0xc000));
+    EXPECT_EQ(0x1234, copy.cpu_.get(WordRegister::BC));
+
+    /* Code compiled by either after the copy is shared, until one loads a
+     * state with different ROM
+     */
+    copy.mmu_.set_native(0x0150, 2);
+    EXPECT_EQ(2u, gb.mmu_.get_native(0x0150));
+    auto state = save();
+    gb.mmu_.poke(0x0150, 0x01);
+    ASSERT_TRUE(load(state));
+    EXPECT_EQ(0u, gb.mmu_.get_native(0x0150));
+    EXPECT_EQ(2u, copy.mmu_.get_native(0x0150));
+    gb.mmu_.set_native(0x0150, 3);
+    EXPECT_EQ(2u, copy.mmu_.get_native(0x0150));
+
+    /* I/O handlers and events act on the copy */
+    copy.mmu_.set(Dma::dma_address, 0xc0);
+    EXPECT_TRUE(copy.dma_.active());
+    EXPECT_FALSE(gb.dma_.active());
+    EXPECT_EQ(0xff, copy.mmu_.get(0xc000));
+    EXPECT_EQ(0x42, gb.mmu_.get(0xc000));
+}
+
+}
@@ -0,0 +1,75 @@
+#include <sstream>
+
+#include <gtest/gtest.h>
+
+#include "gameboy_impl.hpp"
+
+namespace {
+
+using namespace std;
+using namespace mjkgb;
+
+/* LD HL, 0xc000; loop: INC (HL); JR loop */
+const string counter{"\x21\x00\xc0\x34\x18\xfd", 6};
+
+TEST(SteppingTest, Resumes) {
+    stringstream code{counter};
+    Gameboy gb;
+    gb.load(code);
+
+    unsigned frames = 0;
+    gb.setVsyncCallback([&](const Gameboy::frame &) { ++frames; });
+
+    gb.runFrame();
+    EXPECT_EQ(1u, frames);
+    gb.runFrame();
+    gb.runFrame();
+    EXPECT_EQ(3u, frames);
+
+    /* Exactly one VBlank starts in any whole frame's worth of cycles */
+    gb.runCycles(Lcd::cycles_per_frame);
+    EXPECT_EQ(4u, frames);
+    gb.runCycles(Lcd::cycles_per_frame / 2);
+    gb.runCycles(Lcd::cycles_per_frame / 2);
+    EXPECT_EQ(5u, frames);
+}
+
+TEST(SteppingTest, Budget) {
+    stringstream code{counter};
+    GameboyImpl gb;
+    gb.load(code);
+
+    gb.run_until(1000);
+    auto clock = gb.cpu_.get_clock();
+    auto count = gb.mmu_.get(0xc000);
+    EXPECT_LE(1000u, clock);
+    EXPECT_GT(1010u, clock);
+
+    /* Carries on from the same state rather than restarting */
+    gb.run_until(clock + 1000);
+    EXPECT_LE(clock + 1000, gb.cpu_.get_clock());
+    EXPECT_NE(count, gb.mmu_.get(0xc000));
+
+    /* Stops on the first line of VBlank */
+    gb.run_frame();
+    EXPECT_EQ(Lcd::vblank_line, gb.lcd_.ly(gb.cpu_.get_clock()));
+}
+
+TEST(SteppingTest, VblankInterrupt) {
+    /* LD SP, 0xfffe; LD A, 0x01; LDH (0xff), A; EI; loop: JR loop */
+    string code{"\x31\xfe\xff\x3e\x01\xe0\xff\xfb\x18\xfe", 10};
+    code.resize(0x40);
+    /* PUSH HL; LD HL, 0xc000; INC (HL); POP HL; RETI */
+    code += string{"\xe5\x21\x00\xc0\x34\xe1\xd9", 7};
+
+    stringstream stream{code};
+    GameboyImpl gb;
+    gb.load(stream);
+
+    for (auto i = 0; i < 3; ++i)
+        gb.run_frame();
+    gb.run_until(gb.cpu_.get_clock() + 100);
+    EXPECT_EQ(3, gb.mmu_.get(0xc000));
+}
+
+}
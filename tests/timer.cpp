@@ -0,0 +1,80 @@
+#include <sstream>
+
+#include <gtest/gtest.h>
+
+#include "gameboy_impl.hpp"
+
+namespace {
+
+using namespace std;
+using namespace mjkgb;
+
+class TimerTest : public testing::Test {
+protected:
+    GameboyImpl gb;
+};
+
+TEST_F(TimerTest, Div) {
+    auto div = byte_ptr(Constant<Timer::div_address>{});
+
+    gb.cpu_.skip(640);
+    EXPECT_EQ(10, gb.mmu_.get(Timer::div_address));
+
+    gb.set(div, 0x42);
+    EXPECT_EQ(0, gb.mmu_.get(Timer::div_address));
+
+    /* Writing ticks once */
+    gb.cpu_.skip(62);
+    EXPECT_EQ(0, gb.mmu_.get(Timer::div_address));
+    gb.cpu_.skip(1);
+    EXPECT_EQ(1, gb.mmu_.get(Timer::div_address));
+}
+
+TEST_F(TimerTest, Overflow) {
+    gb.mmu_.set(Timer::tma_address, 0xf0);
+    gb.mmu_.set(Timer::tima_address, 0xfe);
+    EXPECT_EQ(Scheduler::never, gb.scheduler_.deadline(Event::TIMER_OVERFLOW));
+
+    /* Enabled, increment every 4 cycles */
+    gb.mmu_.set(Timer::tac_address, 0x05);
+    EXPECT_EQ(0xfd, gb.mmu_.get(Timer::tac_address));
+    EXPECT_EQ(8, gb.scheduler_.deadline(Event::TIMER_OVERFLOW));
+
+    gb.cpu_.skip(4);
+    EXPECT_EQ(0xff, gb.mmu_.get(Timer::tima_address));
+    EXPECT_EQ(0, gb.mmu_.peek(GameboyImpl::interrupt_flag_address));
+
+    gb.cpu_.skip(5);
+    gb.scheduler_.dispatch(gb, gb.cpu_.get_clock());
+    EXPECT_EQ(0xf0, gb.mmu_.get(Timer::tima_address));
+    EXPECT_EQ(0x04, gb.mmu_.peek(GameboyImpl::interrupt_flag_address));
+    EXPECT_EQ(8 + 16 * 4, gb.scheduler_.deadline(Event::TIMER_OVERFLOW));
+
+    /* Disabling the timer cancels the overflow */
+    gb.mmu_.set(Timer::tac_address, 0x01);
+    EXPECT_EQ(Scheduler::never, gb.scheduler_.deadline(Event::TIMER_OVERFLOW));
+}
+
+TEST_F(TimerTest, Interrupt) {
+    /* DI; LD A, 0xff; LDH (0x05), A; LD A, 0x05; LDH (0x07), A;
+     * LD A, 0x04; LDH (0xff), A; EI; JR -2
+     */
+    stringstream code0{string{"\xf3\x3e\xff\xe0\x05\x3e\x05\xe0\x07"
+            "\x3e\x04\xe0\xff\xfb\x18\xfe", 16}};
+    gb.load(code0);
+
+    /* Timer interrupt vector: STOP */
+    gb.mmu_.poke(0x50, 0x10);
+
+    gb.set(WordRegister::PC, 0);
+    gb.set(WordRegister::SP, 0xfffe);
+    gb.run();
+
+    EXPECT_EQ(0x51, gb.get(WordRegister::PC));
+    EXPECT_EQ(0xfffc, gb.get(WordRegister::SP));
+    EXPECT_EQ(0x0e, gb.get(word_ptr(WordRegister::SP)));
+    EXPECT_EQ(0, gb.mmu_.peek(GameboyImpl::interrupt_flag_address));
+    EXPECT_FALSE(gb.cpu_.interrupt_flag());
+}
+
+}
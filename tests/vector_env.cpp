@@ -0,0 +1,99 @@
+#include <algorithm>
+#include <sstream>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "mjkgb.hpp"
+
+namespace {
+
+using namespace std;
+using namespace mjkgb;
+
+class VectorEnvTest : public testing::Test {
+protected:
+    VectorEnvTest()
+    {
+        /* LD HL, 0xc000; loop: INC (HL); JR loop */
+        stringstream code{string{"\x21\x00\xc0\x34\x18\xfd", 6}};
+        prototype.load(code);
+    }
+
+    Gameboy prototype;
+};
+
+TEST_F(VectorEnvTest, FrameStack) {
+    VectorEnv env{prototype, 4, 2};
+    env.addRamObservation(0xc000, 1);
+    env.addRamObservation(0x0000, 1);
+    env.setFrameStack(3);
+    ASSERT_EQ(6u, env.observationSize());
+
+    const size_t stride = 8;
+    vector<uint8_t> obs(env.size() * stride, 0xaa);
+    vector<uint8_t> actions(env.size());
+
+    env.observe(obs.data(), stride);
+    env.step(actions.data(), obs.data(), stride);
+    auto first = obs[4];
+    env.step(actions.data(), obs.data(), stride);
+    auto second = obs[4];
+    EXPECT_NE(first, second);
+
+    for (size_t i = 0; i < env.size(); ++i) {
+        auto slot = &obs[i * stride];
+        EXPECT_EQ(0x00, slot[0]);
+        EXPECT_EQ(0x21, slot[1]);
+        EXPECT_EQ(first, slot[2]);
+        EXPECT_EQ(0x21, slot[3]);
+        EXPECT_EQ(second, slot[4]);
+        EXPECT_EQ(0x21, slot[5]);
+        EXPECT_EQ(0xaa, slot[6]);
+        EXPECT_EQ(0xaa, slot[7]);
+    }
+}
+
+TEST_F(VectorEnvTest, MaxPool) {
+    VectorEnv plain{prototype, 1, 1};
+    VectorEnv pooled{prototype, 1, 1};
+    plain.addRamObservation(0xc000, 1);
+    pooled.addRamObservation(0xc000, 1);
+    pooled.setMaxPool(true);
+
+    uint8_t action = 0, previous = 0, raw = 0, max_pooled = 0;
+    plain.observe(&previous, 1);
+    pooled.observe(&max_pooled, 1);
+    for (auto i = 0; i < 8; ++i) {
+        plain.step(&action, &raw, 1);
+        pooled.step(&action, &max_pooled, 1);
+        EXPECT_EQ(max(raw, previous), max_pooled);
+        previous = raw;
+    }
+}
+
+TEST_F(VectorEnvTest, WrapsAround) {
+    VectorEnv env{prototype, 1, 1};
+    env.addRamObservation(0xffff, 3);
+
+    vector<uint8_t> obs(4, 0xaa);
+    env.observe(obs.data(), obs.size());
+    EXPECT_EQ(0x21, obs[1]);
+    EXPECT_EQ(0x00, obs[2]);
+    EXPECT_EQ(0xaa, obs[3]);
+}
+
+TEST_F(VectorEnvTest, Actions) {
+    VectorEnv env{prototype, 3, 2};
+    vector<int> seen(env.size());
+    env.setActionCallback([&](size_t index, uint8_t action, Gameboy &) {
+        seen[index] = action;
+    });
+
+    vector<uint8_t> actions{ 1, 2, 3 };
+    uint8_t obs;
+    env.step(actions.data(), &obs, 0);
+    EXPECT_EQ(vector<int>({ 1, 2, 3 }), seen);
+}
+
+}